@@ -0,0 +1,211 @@
+#ifndef BITBOARD_H
+#define BITBOARD_H
+
+#include "ccheck.h"
+#include "hash.h"
+#include "nnue.h"
+
+/*
+ * Bitboard representation of a game position.
+ *
+ * Each side's pieces are kept as a 128-bit set over the holes of the board,
+ * numbered as described in hash.h, so that step and hop destinations for
+ * all of a side's pieces can be found at once by shifting and masking.
+ * The operations mirror the library's Board interface (newbd, copybd, apply,
+ * undo, moves, game_over, eval) and produce identical moves and scores.
+ */
+
+#define MAXMOVES 1000                     // Room needed for the moves of one position
+#define WINEVAL (MAXEVAL - 1)             // Score of a game that has been won
+
+/* A set of holes; bit n stands for square n. */
+typedef unsigned __int128 Bits;
+
+#define BIT(sq) ((Bits)1 << (sq))
+
+/* Lowest numbered square in a nonempty set. */
+static inline int first_square(Bits b) {
+    uint64_t lo = (uint64_t)b;
+    return lo != 0 ? __builtin_ctzll(lo) : 64 + __builtin_ctzll((uint64_t)(b >> 64));
+}
+
+/* Number of squares in a set. */
+static inline int count_squares(Bits b) {
+    return __builtin_popcountll((uint64_t)b) + __builtin_popcountll((uint64_t)(b >> 64));
+}
+
+/* Game position. */
+typedef struct bitboard {
+    Bits pieces[2];                       // Holes occupied by X and by O
+    HashKey key;                          // Zobrist key, kept up to date by bb_apply/bb_undo
+    int score;                            // Evaluation for X short of a win, likewise
+    int16_t acc[NNUE_HIDDEN];             // Accumulator of nnue_net if there is one, likewise
+    Player tomove;                        // Player whose turn it is
+    int moveno;                           // Number of the pending move
+} Bitboard;
+
+/* Initial positions of the two sides, which are also each other's targets. */
+extern Bits home[2];
+
+/* Counters kept by the move generators and bb_eval, like those the library
+ * keeps for print_stats.  Each thread has its own. */
+typedef struct bb_stats {
+    long nodes;                           // Positions evaluated
+    long stepgens, steptot;               // Calls to bb_step_moves, moves generated
+    long jumpgens, jumptot;               // Calls to bb_jump_moves, moves generated
+} BBStats;
+
+extern _Thread_local BBStats bb_stats;
+
+/**
+ * Set up a bitboard in the state corresponding to the start of a game.
+ *
+ * @param bp  The bitboard to be initialized.
+ */
+void bb_newbd(Bitboard *bp);
+
+/**
+ * Set up a bitboard in a given position.  The pending move is taken to be
+ * the first or second of the game, according to the side to move.
+ *
+ * @param bp  The bitboard to be initialized.
+ * @param white  The holes occupied by X.
+ * @param black  The holes occupied by O.
+ * @param tomove  The player whose turn it is.
+ */
+void bb_setup(Bitboard *bp, Bits white, Bits black, Player tomove);
+
+/**
+ * Set up a bitboard in the same state as a library game board.
+ *
+ * @param obp  The library board to be copied.
+ * @param bp  The bitboard to be initialized.
+ * @return  0 if successful, -1 if the board could not be read.
+ */
+int bb_from_board(Board *obp, Bitboard *bp);
+
+/**
+ * Copy the contents of one bitboard to another.
+ *
+ * @param obp  The bitboard to be copied.
+ * @param bp  The destination for the copy.
+ */
+static inline Bitboard *bb_copybd(const Bitboard *obp, Bitboard *bp) {
+    *bp = *obp;
+    return bp;
+}
+
+/**
+ * Apply a move to a bitboard.  As with apply, the move is assumed to be legal.
+ * A move whose origin and destination coincide just passes the turn.
+ *
+ * @param bp  The bitboard to which the move is to be applied.
+ * @param m  The move to apply.
+ */
+void bb_apply(Bitboard *bp, Move m);
+
+/**
+ * Retract a move from a bitboard.  Unlike undo, the move is passed in, so that
+ * the bitboard need not carry the game history.
+ *
+ * @param bp  The bitboard from which the move is to be retracted.
+ * @param m  The move to retract, which must be the last move applied.
+ */
+void bb_undo(Bitboard *bp, Move m);
+
+/**
+ * Generate the step moves for the side to move.
+ *
+ * @param bp  The position.
+ * @param list  Array that receives the moves (at least MAXMOVES entries).
+ * @return  The number of moves generated.
+ */
+int bb_step_moves(const Bitboard *bp, Move *list);
+
+/**
+ * Generate the jump moves (single and multiple hops) for the side to move.
+ * Each destination that a piece can reach is generated once, no matter how
+ * many different chains of hops lead there; use bb_jump_path to recover
+ * the hops themselves.
+ *
+ * @param bp  The position.
+ * @param list  Array that receives the moves (at least MAXMOVES entries).
+ * @return  The number of moves generated.
+ */
+int bb_jump_moves(const Bitboard *bp, Move *list);
+
+/**
+ * Determine whether a move is legal, by looking only at the piece that
+ * moves, which is much cheaper than generating every move of the position.
+ *
+ * @param bp  The position in which the move is to be made.
+ * @param m  The move.
+ * @return  1 if the move is legal, otherwise 0.
+ */
+int bb_legal(const Bitboard *bp, Move m);
+
+/**
+ * Find the shortest chain of hops that makes a jump move.
+ *
+ * @param bp  The position in which the move is to be made.
+ * @param m  The jump move.
+ * @param path  Array that receives the holes visited, starting with the origin
+ * and ending with the destination (at most NSQUARES entries).
+ * @return  The number of holes in the path, or 0 if m is not a jump in bp.
+ */
+int bb_jump_path(const Bitboard *bp, Move m, int *path);
+
+/**
+ * Print a move to a specified output stream, in the same format as print_move
+ * except that a jump lists every hole it hops through, e.g. "white:A3-C3-C5".
+ *
+ * @param bp  The position in which the move is to be made.
+ * @param m  The move to be printed.
+ * @param s  The output stream to which the move is to be printed.
+ */
+void bb_print_move(const Bitboard *bp, Move m, FILE *s);
+
+/**
+ * Read a move in the format printed by print_move or bb_print_move, e.g.
+ * "white:A3-C3-C5", without the library's legality check.  Only the syntax,
+ * the player and the end points are checked; use moveset_legal (frame.h)
+ * to check that the move can be made.
+ *
+ * @param bp  The position in which the move is to be made.
+ * @param text  The move, which ends at a null or at white space.
+ * @return  The move, or 0 if the text is not a move by the side to move.
+ */
+Move bb_parse_move(const Bitboard *bp, const char *text);
+
+/**
+ * Generate all legal moves for the side to move.
+ *
+ * @param bp  The position.
+ * @param list  Array that receives the moves (at least MAXMOVES entries).
+ * @return  The number of moves generated.
+ */
+int bb_moves(const Bitboard *bp, Move *list);
+
+/**
+ * Determine whether a bitboard represents a game that has ended.
+ *
+ * @param bp  The position.
+ * @return 1 if X has won, -1 if O has won, or 0 if the game has not yet ended.
+ */
+int bb_game_over(const Bitboard *bp);
+
+/**
+ * Static evaluation of a position, computing the same score as eval.  Its
+ * terms are sums over the pieces, kept up to date by bb_apply and bb_undo,
+ * so this only has to check for a win.  If a network has been loaded
+ * (nnue.h), its output is added to the score.  A debug build (make debug)
+ * checks the running sums against ones worked out from scratch, and aborts
+ * if they differ.
+ *
+ * @param bp  The position.
+ * @param p  The player from whose point of view the score is given.
+ * @return  The score, or +/-(MAXEVAL-1) if the game has been won or lost.
+ */
+int bb_eval(const Bitboard *bp, Player p);
+
+#endif /* BITBOARD_H */
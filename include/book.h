@@ -0,0 +1,70 @@
+#ifndef BOOK_H
+#define BOOK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+
+/*
+ * Opening book.
+ *
+ * A book file holds the moves played from positions early in the game,
+ * keyed by the positions' Zobrist keys (which are stable from run to run)
+ * and sorted by key so that a position is found by binary search.  The
+ * engine maps the file read-only rather than reading it, so that any number
+ * of engine processes using the same book share one copy in the page cache.
+ *
+ * The file is a BookHeader followed by its entries, in host byte order.
+ * A position may have several entries, one per move, next to each other.
+ */
+
+#define BOOK_MAGIC "CCBOOK1"              // Identifies a book file (with its NUL)
+
+typedef struct book_header {
+    char magic[8];                        // BOOK_MAGIC
+    uint64_t count;                       // Number of entries that follow
+} BookHeader;
+
+typedef struct book_entry {
+    HashKey key;                          // Key of the position
+    uint32_t move;                        // Move played from it
+    uint32_t weight;                      // How often it was played
+} BookEntry;
+
+/* Book file given on the command line, or NULL for none. */
+extern char *book_file;
+
+/**
+ * Map a book file into memory, replacing any book already open.
+ *
+ * @param path  The name of the book file.
+ * @return  0 if successful, -1 if the file could not be mapped or is not a book.
+ */
+int book_open(const char *path);
+
+/**
+ * Look a position up in the open book.  Of the moves recorded for it, the
+ * one played most often is chosen, unless play is randomized, in which case
+ * each is chosen in proportion to how often it was played.  Moves that are
+ * not legal in the position (as after a key collision) are ignored.
+ *
+ * @param bp  The position.
+ * @param m  Receives the book move.
+ * @return  1 if the position is in the book, 0 if not (or no book is open).
+ */
+int book_probe(const Bitboard *bp, Move *m);
+
+/**
+ * Write a book file.  The entries are sorted, and entries for the same
+ * position and move are merged, adding their weights.
+ *
+ * @param path  The name of the book file.
+ * @param entries  The entries, which are reordered.
+ * @param n  The number of entries.
+ * @return  The number of entries written, or -1 if the file could not be written.
+ */
+long book_write(const char *path, BookEntry *entries, size_t n);
+
+#endif /* BOOK_H */
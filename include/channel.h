@@ -0,0 +1,90 @@
+#ifndef CHANNEL_H
+#define CHANNEL_H
+
+#include "ccheck.h"
+
+/*
+ * Single-producer, single-consumer message queue, used in place of a pipe
+ * and SIGHUP when the engine runs as a thread of the game process.
+ *
+ * The queue is a ring of slots indexed by two counters, each written by only
+ * one side, so sending and receiving take no locks.  A receiver with nothing
+ * to do sleeps on a futex, and is woken by the next send only if it is
+ * actually asleep, so the common case makes no system call at all.
+ */
+
+/* Messages, matching the lines of the engine protocol. */
+#define MSG_REQUEST 1                     // "<": choose a move
+#define MSG_OPPONENT 2                    // ">move": the opponent has moved
+#define MSG_MOVE 3                        // The engine's reply to MSG_REQUEST
+#define MSG_OK 4                          // The engine's reply to MSG_OPPONENT
+#define MSG_QUIT 5                        // End of input: the engine should stop
+
+#define CHANNEL_SIZE 16                   // Slots in the ring (a power of two)
+
+typedef struct message {
+    int type;                             // One of MSG_*
+    Move move;                            // The move, for MSG_OPPONENT and MSG_MOVE
+    int depth;                            // MSG_MOVE: depth of the last completed search (0 if none)
+    int score;                            // MSG_MOVE: its score, from the engine's view
+    long nodes;                           // MSG_MOVE: positions searched since the move was asked for
+} Message;
+
+typedef struct channel {
+    unsigned head;                        // Slots received so far (written by the receiver)
+    unsigned tail;                        // Slots sent so far (written by the sender)
+    int sleeping;                         // The receiver is waiting on tail
+    int notify;                           // eventfd written on each send, or -1
+    Message ring[CHANNEL_SIZE];
+} Channel;
+
+/**
+ * Set up an empty channel.
+ *
+ * @param ch  The channel.
+ */
+void channel_init(Channel *ch);
+
+/**
+ * Also announce each message sent by adding one to an eventfd, for a
+ * receiver that waits for it with poll or epoll rather than channel_wait.
+ *
+ * @param ch  The channel.
+ * @param fd  The eventfd, or -1 for none.
+ */
+void channel_notify(Channel *ch, int fd);
+
+/**
+ * Send a message, waiting for room if the ring is full.
+ * Only one thread may send on a channel.
+ *
+ * @param ch  The channel.
+ * @param msg  The message.
+ */
+void channel_send(Channel *ch, Message msg);
+
+/**
+ * Determine whether a message is waiting, without receiving it.
+ *
+ * @param ch  The channel.
+ * @return  1 if a message is waiting, otherwise 0.
+ */
+int channel_pending(Channel *ch);
+
+/**
+ * Receive the next message, sleeping until one is sent if need be.
+ * Only one thread may receive from a channel.
+ *
+ * @param ch  The channel.
+ * @return  The message.
+ */
+Message channel_receive(Channel *ch);
+
+/**
+ * Sleep until a message is waiting, without receiving it.
+ *
+ * @param ch  The channel.
+ */
+void channel_wait(Channel *ch);
+
+#endif /* CHANNEL_H */
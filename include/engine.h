@@ -0,0 +1,58 @@
+#ifndef ENGINE_H
+#define ENGINE_H
+
+#include <pthread.h>
+
+#include "ccheck.h"
+#include "channel.h"
+
+/*
+ * Options that configure the engine, shared by ccheck and the tools that run
+ * engines of their own.  The engine itself is started by engine() (ccheck.h).
+ */
+
+/* getopt letters of the engine options, for inclusion in an option string. */
+#define ENGINE_OPTIONS "ra:H:R:T:D:S:B:PM:N:"
+
+/* Whether the engine thinks on the opponent's time, set from the command line. */
+extern int ponder_enabled;
+
+/**
+ * Handle a command-line option that configures the engine:
+ *   -r           randomized play
+ *   -a <num>     set average time per move (in seconds, e.g. 0.1)
+ *   -H <num>     set engine hash table size (in megabytes)
+ *   -R <policy>  set hash table replacement policy ("depth" or "always")
+ *   -T <num>     set number of engine search threads
+ *   -D <num>     set maximum engine search depth (in ply)
+ *   -S <search>  set engine search algorithm ("alphabeta" or "pvs")
+ *   -B <file>    specify engine opening book file
+ *   -P           don't think on the opponent's time
+ *   -M <file>    append a record of each search iteration to a file (see telemetry.h)
+ *   -N <file>    correct the evaluation with a network file (see nnue.h)
+ *
+ * @param option  The option letter.
+ * @param arg  Its argument, if it takes one.
+ * @return  0 if the option was handled, or -1 if it is not an engine option
+ * or its argument is unacceptable, in which case a message has been printed.
+ */
+int engine_option(int option, char *arg);
+
+/**
+ * Start the engine in a thread of the calling process, instead of in a
+ * process of its own as engine() does.  Commands are sent to it, and its
+ * replies received, as messages on channels instead of lines on pipes, and
+ * no signals are involved: a command waiting on the channel is enough to
+ * interrupt a search.  The thread blocks all signals.  Only one engine may
+ * run in a process.
+ *
+ * @param bp  The position to start from, which the engine copies.
+ * @param commands  Channel on which the engine receives MSG_REQUEST,
+ * MSG_OPPONENT and MSG_QUIT.
+ * @param replies  Channel on which it sends MSG_MOVE and MSG_OK in reply.
+ * @param tid  Receives the ID of the thread, to be joined after MSG_QUIT.
+ * @return  0 if successful, -1 if the thread could not be started.
+ */
+int engine_start_thread(Board *bp, Channel *commands, Channel *replies, pthread_t *tid);
+
+#endif /* ENGINE_H */
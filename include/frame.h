@@ -0,0 +1,91 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+
+/*
+ * Binary form of the engine protocol, used on the pipes between the game and
+ * an engine process.
+ *
+ * An engine that understands frames says so in its greeting, and the game
+ * then sends it fixed-size frames instead of text lines.  Each frame is
+ * answered with a frame.  A frame carries the move itself, so nobody has to
+ * print or parse it.  It also carries the holes a jump hops through, so the
+ * receiver need not rebuild them from its board to show the move, and what
+ * the search behind a move found, for the game log.  A text command starts
+ * with '<' or '>', which no frame type does, so the engine accepts either
+ * form; displays and versus keep using text.
+ *
+ * A move received in a frame is checked against a set of the legal moves of
+ * the position.  The receiver gathers the set while it waits for the move,
+ * so the check itself is a single lookup.
+ */
+
+#define FRAME_HELLO "Engine ready (frames)\n" // Greeting of an engine that takes frames
+#define FRAME_MAXPATH 13                  // Longest hop path carried; longer ones are left out
+
+typedef struct frame {
+    uint8_t type;                         // One of MSG_* (see channel.h)
+    uint8_t npath;                        // Holes in path, or 0 if not given
+    uint8_t depth;                        // MSG_MOVE: as in Message
+    uint8_t path[FRAME_MAXPATH];          // The holes a move visits, origin to destination
+    uint32_t move;                        // The move, for MSG_OPPONENT and MSG_MOVE
+    int32_t score;                        // MSG_MOVE: as in Message
+    uint64_t nodes;                       // MSG_MOVE: as in Message
+} Frame;
+
+#define FRAME_SIZE ((int)sizeof(Frame))
+
+#define MOVESET_SIZE 2048                 // Slots in a move set (a power of two over MAXMOVES)
+
+/* The legal moves of one position, as an open-addressed hash set. */
+typedef struct moveset {
+    HashKey key;                          // The position
+    int filled;                           // The slots hold its moves
+    Move slot[MOVESET_SIZE];              // The moves, with 0 marking empty slots
+} MoveSet;
+
+/**
+ * Fill in a frame, with the hop path of a move if it has one.
+ *
+ * @param f  The frame.
+ * @param type  The message type, one of MSG_*.
+ * @param bp  The position in which the move is to be made.
+ * @param m  The move, or 0 for none.
+ */
+void frame_make(Frame *f, int type, const Bitboard *bp, Move m);
+
+/**
+ * Print the move a frame carries from its hop path, in the same format as
+ * bb_print_move.
+ *
+ * @param f  The frame.
+ * @param s  The output stream to which the move is to be printed.
+ * @return  0 if successful, or -1 if the frame has no path.
+ */
+int frame_print_move(const Frame *f, FILE *s);
+
+/**
+ * Gather the legal moves of a position, unless the set already holds them.
+ *
+ * @param ms  The set.
+ * @param bp  The position.
+ */
+void moveset_fill(MoveSet *ms, const Bitboard *bp);
+
+/**
+ * Determine whether a move is legal, gathering the legal moves of the
+ * position first if the set does not already hold them.
+ *
+ * @param ms  The set.
+ * @param bp  The position.
+ * @param m  The move.
+ * @return  1 if the move is legal, otherwise 0.
+ */
+int moveset_legal(MoveSet *ms, const Bitboard *bp, Move m);
+
+#endif /* FRAME_H */
@@ -0,0 +1,147 @@
+#ifndef GAMELOG_H
+#define GAMELOG_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "ccheck.h"
+#include "position.h"
+
+/*
+ * Binary game log, an append-only file of games for analysis tools.
+ *
+ * Each game is a header followed by one fixed-size record per move, holding
+ * the move in its packed form along with the time taken to choose it and,
+ * for the engine's moves, the depth, score and node count of the search.
+ * A game that did not begin at the start has its starting position, as
+ * encoded by position.h, in the header.
+ * The header's move count is kept up to date as the game goes, so a log cut
+ * short by a crash is still readable.  After the last game comes an index
+ * of the offsets of all the games and a footer; a writer appending to the
+ * log strips the index off and writes a new one when it is done.  A reader
+ * maps the file, finds the index from the footer, and can go straight to
+ * any game; if there is no index (a writer died), it finds the games by
+ * walking the headers instead.
+ */
+
+#define GAMELOG_GAME "CCGAME1"            // Magic number of each game header
+#define GAMELOG_INDEX "CCINDX1"           // Magic number of the footer
+
+/* Flags of a move record. */
+#define LOG_ENGINE 0x1                    // Made by the engine
+#define LOG_HISTORY 0x2                   // Replayed from a saved game (-i), not played
+
+typedef struct log_game {
+    char magic[8];                        // GAMELOG_GAME
+    uint32_t nmoves;                      // Move records that follow
+    int32_t result;                       // 1 if white won, -1 if black won, 0 if unfinished
+    int64_t started;                      // Time the game began (seconds since the epoch)
+    int32_t engine_player;                // Side the engine played (X or O), or -1
+    uint32_t reserved;
+    Position start;                       // Starting position, or all zero for the start of a game
+} LogGame;
+
+typedef struct log_record {
+    uint32_t move;                        // The move, as packed by the library
+    uint32_t ms;                          // Time taken to choose it
+    int32_t score;                        // The engine's score, from the mover's view
+    uint16_t depth;                       // Depth of the engine's last completed search
+    uint16_t flags;                       // LOG_* flags
+    uint64_t nodes;                       // Positions the engine searched for it
+} LogRecord;
+
+typedef struct log_footer {
+    uint64_t ngames;                      // Offsets in the index, which precedes the footer
+    char magic[8];                        // GAMELOG_INDEX
+} LogFooter;
+
+/* A log being written. */
+typedef struct game_log {
+    int fd;
+    uint64_t *offsets;                    // Offset of each game so far
+    uint64_t ngames;
+    LogGame game;                         // Header of the game in progress
+    int in_game;
+} GameLog;
+
+/* A log mapped for reading. */
+typedef struct log_view {
+    const char *map;
+    size_t size;
+    size_t end;                           // End of the games, where the index starts
+    const uint64_t *offsets;              // Offset of each game
+    uint64_t ngames;
+    uint64_t *scanned;                    // Offsets found by walking the headers, if there is no index
+} LogView;
+
+/**
+ * Open a log for appending games, creating it if need be.
+ *
+ * @param path  Name of the file.
+ * @return  The log, or NULL if it could not be opened or is not a game log.
+ */
+GameLog *gamelog_open(const char *path);
+
+/**
+ * Start a new game in a log.
+ *
+ * @param log  The log.
+ * @param engine_player  Side the engine plays, or -1.
+ * @param start  The starting position, or NULL for the start of a game.
+ * @return  0 if successful, otherwise -1.
+ */
+int gamelog_begin(GameLog *log, int engine_player, const Position *start);
+
+/**
+ * Append a move to the game in progress.
+ *
+ * @param log  The log.
+ * @param rec  The record of the move.
+ * @return  0 if successful, otherwise -1.
+ */
+int gamelog_move(GameLog *log, const LogRecord *rec);
+
+/**
+ * Record the result of the game in progress.
+ *
+ * @param log  The log.
+ * @param result  1 if white won, -1 if black won.
+ * @return  0 if successful, otherwise -1.
+ */
+int gamelog_result(GameLog *log, int result);
+
+/**
+ * Write the index and close a log.
+ *
+ * @param log  The log, which is freed.
+ * @return  0 if successful, otherwise -1.
+ */
+int gamelog_close(GameLog *log);
+
+/**
+ * Map a log for reading.
+ *
+ * @param path  Name of the file.
+ * @param view  Where to set up the view of it.
+ * @return  0 if successful, otherwise -1.
+ */
+int gamelog_map(const char *path, LogView *view);
+
+/**
+ * Find a game in a mapped log.
+ *
+ * @param view  The log.
+ * @param i  Number of the game, from 0.
+ * @param records  Where to store a pointer to its move records.
+ * @return  Its header, or NULL if there is no such game.
+ */
+const LogGame *gamelog_game(const LogView *view, uint64_t i, const LogRecord **records);
+
+/**
+ * Unmap a log.
+ *
+ * @param view  The log.
+ */
+void gamelog_unmap(LogView *view);
+
+#endif /* GAMELOG_H */
@@ -0,0 +1,108 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <stdint.h>
+
+#include "ccheck.h"
+
+/*
+ * Zobrist hashing and the transposition table used by the search.
+ *
+ * Holes on the 9x9 board are numbered row * BOARD_SIZE + col, using the same
+ * row/column numbering as the row_from/col_from accessors in ccheck.h.
+ */
+
+#define BOARD_SIZE 9                      // Rows (and columns) on the board
+#define NSQUARES (BOARD_SIZE * BOARD_SIZE) // Number of holes on the board
+
+/* Square numbers of the origin and destination of a move. */
+#define SQ_FROM(m) (row_from(m) * BOARD_SIZE + col_from(m))
+#define SQ_TO(m) (row_to(m) * BOARD_SIZE + col_to(m))
+
+/* Type of a Zobrist hash key. */
+typedef uint64_t HashKey;
+
+/* Bound types stored with a transposition table score. */
+#define TT_EXACT 0                        // Score is exact
+#define TT_LOWER 1                        // Score is a lower bound (fail high)
+#define TT_UPPER 2                        // Score is an upper bound (fail low)
+
+/* Replacement policies for the transposition table. */
+#define TT_REPLACE_DEPTH 0                // Keep the deeper entry unless it is stale
+#define TT_REPLACE_ALWAYS 1               // Always overwrite with the newest entry
+
+/* Transposition table entry, as returned by tt_probe.  The table itself
+ * keeps entries packed, so the ranges of the fields are limited to what
+ * the search needs (moves of 20 bits, depths below 256). */
+typedef struct tt_entry {
+    HashKey key;                          // Full key of the stored position
+    Move move;                            // Best (or refutation) move found
+    int score;                            // Score from the side to move's view
+    short depth;                          // Remaining depth of the stored search
+    unsigned char bound;                  // One of TT_EXACT, TT_LOWER, TT_UPPER
+    unsigned char age;                    // Search generation that wrote the entry
+} TTEntry;
+
+/* Configuration, set from the command line before the engine is started. */
+extern int hash_mb;                       // Transposition table size in megabytes
+extern int hash_policy;                   // Replacement policy (TT_REPLACE_*)
+
+/* Zobrist keys, indexed by player and square, plus the side-to-move key. */
+extern HashKey zobrist[2][NSQUARES];
+extern HashKey zobrist_side;
+
+/**
+ * Make sure the Zobrist keys have been generated.
+ */
+void hash_init(void);
+
+/**
+ * Allocate (or reallocate) the transposition table according to hash_mb.
+ * The table is cleared.  Calling this more than once is allowed.
+ *
+ * @return  0 if successful, -1 if memory could not be obtained.
+ */
+int tt_init(void);
+
+/**
+ * Start a new search generation.  Entries written during earlier generations
+ * become preferred candidates for replacement, but remain usable.
+ * This also resets the calling thread's statistics.  It must be called by
+ * one thread only, once per move, while no other thread is searching.
+ */
+void tt_new_search(void);
+
+/**
+ * Reset the calling thread's statistics without starting a new generation.
+ * Helper threads use this, so that they share the main thread's generation.
+ */
+void tt_reset_stats(void);
+
+/**
+ * Look up a position in the transposition table.
+ * The table may be probed and stored into by several threads at once.
+ *
+ * @param key  The hash key of the position.
+ * @param e  Receives a copy of the matching entry, if there is one.
+ * @return  1 if an entry was found, 0 if there is none.
+ */
+int tt_probe(HashKey key, TTEntry *e);
+
+/**
+ * Record the result of a search in the transposition table, subject to
+ * the configured replacement policy.
+ *
+ * @param key  The hash key of the position.
+ * @param move  The best move found, or 0 if none.
+ * @param score  The score found, from the point of view of the side to move.
+ * @param depth  The remaining depth to which the position was searched.
+ * @param bound  One of TT_EXACT, TT_LOWER, TT_UPPER.
+ */
+void tt_store(HashKey key, Move move, int score, int depth, int bound);
+
+/**
+ * Print transposition table statistics for the calling thread to stderr.
+ */
+void tt_print_stats(void);
+
+#endif /* HASH_H */
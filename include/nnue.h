@@ -0,0 +1,119 @@
+#ifndef NNUE_H
+#define NNUE_H
+
+#include <stdint.h>
+
+#include "hash.h"
+
+/*
+ * Learned evaluation: a small quantized network over piece-square features,
+ * whose first layer is kept up to date incrementally ("NNUE").
+ *
+ * The inputs are one feature for each side and hole, set when a piece of
+ * that side occupies the hole.  The first layer's weighted sums of them, its
+ * accumulator, live in each Bitboard and are kept up to date by bb_apply and
+ * bb_undo, which add one row of the first layer's weights for the hole a
+ * piece moves to and subtract the row for the hole it leaves.  The output is
+ * worked out from the accumulator in bb_eval, by clamping each sum to
+ * [0, NNUE_QA] and taking a weighted sum of the results, plus a bias that
+ * depends on the side to move.
+ *
+ * The output is a correction to the handwritten evaluation, for X, which
+ * bb_eval adds to it: the network learns what a search sees that the
+ * handwritten terms miss, and a network that has learned nothing leaves
+ * the evaluation as it was.
+ *
+ * Weights are 16-bit integers, so that the work is done by kernels that
+ * handle 16 (AVX2) or 8 (SSE) of them at once; which is used is decided when
+ * a network is loaded, according to what the processor supports, with plain
+ * C for anything else.
+ *
+ * A network file is an NnueHeader followed by a Network, in host byte order.
+ * The nnuetrain tool makes them.
+ */
+
+#define NNUE_MAGIC "CCNNUE1"              // Identifies a network file (with its NUL)
+#define NNUE_FEATURES (2 * NSQUARES)      // A piece of either side on any hole
+#define NNUE_HIDDEN 32                    // Sums kept in the accumulator
+#define NNUE_QA 127                       // First layer weight (and activation) for 1.0
+#define NNUE_QB 64                        // Output layer weight for 1.0
+#define NNUE_SCALE 1024                   // Evaluation units per 1.0 of output
+
+typedef struct nnue_header {
+    char magic[8];                        // NNUE_MAGIC
+    uint32_t features, hidden;            // NNUE_FEATURES and NNUE_HIDDEN
+} NnueHeader;
+
+typedef struct network {
+    int16_t w1[NNUE_FEATURES][NNUE_HIDDEN]; // First layer weights, a row per feature
+    int16_t b1[NNUE_HIDDEN];              // First layer biases
+    int16_t w2[NNUE_HIDDEN];              // Output layer weights
+    int32_t b2[2];                        // Output bias with X and with O to move, scaled
+                                          // by NNUE_QA * NNUE_QB
+} Network;
+
+/* The network bb_eval uses, or NULL for none. */
+extern const Network *nnue_net;
+
+/* Add one row of weights to an accumulator and subtract another. */
+extern void (*nnue_update)(int16_t *acc, const int16_t *add, const int16_t *sub);
+
+/**
+ * Load a network file and use it from then on.  The bitboards in use when
+ * this is called have no accumulators, so it should be called before any
+ * are set up.
+ *
+ * @param path  The name of the network file.
+ * @return  0 if successful, -1 if the file could not be read or is not a
+ * network file.
+ */
+int nnue_load(const char *path);
+
+/**
+ * Use a network that is already in memory, or stop using one.
+ *
+ * @param net  The network, which must stay in place while it is in use, or
+ * NULL for the handwritten evaluation.
+ */
+void nnue_use(const Network *net);
+
+/**
+ * Write a network file.
+ *
+ * @param path  The name of the network file.
+ * @param net  The network.
+ * @return  0 if successful, -1 if the file could not be written.
+ */
+int nnue_save(const char *path, const Network *net);
+
+/**
+ * Name of the kernels the network is worked out with: "avx2", "sse2" or
+ * "scalar".
+ */
+const char *nnue_kernel_name(void);
+
+/**
+ * Work out an accumulator from scratch.
+ *
+ * @param acc  The accumulator (NNUE_HIDDEN sums).
+ * @param features  The features that are set.
+ * @param n  How many there are.
+ */
+void nnue_refresh(int16_t *acc, const int *features, int n);
+
+/**
+ * The output of the network in use.
+ *
+ * @param acc  The accumulator of a position.
+ * @param tomove  The player whose turn it is.
+ * @return  The correction to the handwritten score of the position for X,
+ * in evaluation units.
+ */
+int nnue_output(const int16_t *acc, int tomove);
+
+/* Update an accumulator for a piece of player p moving from one hole to another. */
+static inline void nnue_move(int16_t *acc, int p, int from, int to) {
+    nnue_update(acc, nnue_net->w1[p * NSQUARES + to], nnue_net->w1[p * NSQUARES + from]);
+}
+
+#endif /* NNUE_H */
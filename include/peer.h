@@ -0,0 +1,107 @@
+#ifndef PEER_H
+#define PEER_H
+
+#include <sys/types.h>
+
+/*
+ * Connection to a child process (the display or the engine) that speaks the
+ * line protocol, for use from an event loop.
+ *
+ * Replies are read from a non-blocking pipe into a buffer and taken out a
+ * line at a time once complete.  A child woken twice by SIGHUP before it
+ * looks at its input sees only one signal, so each command has to be
+ * answered before the next is sent: commands sent while one is outstanding
+ * are queued, and go out one by one as the replies come in.
+ *
+ * A connection can also carry fixed-size binary frames (see frame.h) in
+ * place of lines, in both directions.
+ */
+
+#define PEER_BUFSIZE 256                  // Longest reply line, with its newline
+#define PEER_HELLO '!'                    // Outstanding "command": the greeting a child sends once ready
+
+typedef struct peer {
+    const char *name;                     // For messages, e.g. "Engine"
+    pid_t pid;                            // The child, signaled after each command
+    int in;                               // Non-blocking pipe from the child, or -1 if none
+    int out;                              // Pipe to the child
+    int awaiting;                         // First byte of the command awaiting a reply, or 0
+    int framed;                           // Size of the frames exchanged instead of lines, or 0
+    char buf[PEER_BUFSIZE];               // Input not yet taken as lines or frames
+    int len;
+    char *queue;                          // Commands not yet sent, one after another
+    size_t queued;
+} Peer;
+
+/**
+ * Set up a connection to a child that has just been started, and which will
+ * announce that it is ready with a line of its own.
+ *
+ * @param p  The connection.
+ * @param name  Name of the child, for messages.
+ * @param pid  Process ID of the child.
+ * @param in  Read end of the pipe from the child, which is made non-blocking.
+ * @param out  Write end of the pipe to the child.
+ * @return  0 if successful, otherwise -1.
+ */
+int peer_start(Peer *p, const char *name, pid_t pid, int in, int out);
+
+/**
+ * Send a command, or queue it if an earlier one has not yet been answered.
+ *
+ * @param p  The connection.
+ * @param cmd  The command, a single line ending with a newline.
+ * @return  0 if successful, otherwise -1 (the child has gone away).
+ */
+int peer_send(Peer *p, const char *cmd);
+
+/**
+ * Send a frame, or queue it if an earlier command has not yet been answered.
+ *
+ * @param p  The connection, which must be carrying frames.
+ * @param frame  The frame, of p->framed bytes.
+ * @return  0 if successful, otherwise -1 (the child has gone away).
+ */
+int peer_send_frame(Peer *p, const void *frame);
+
+/**
+ * Read whatever the child has written so far, without blocking.
+ *
+ * @param p  The connection.
+ * @return  0 if successful, otherwise -1 (end of file, an error, or a line
+ * too long to buffer).
+ */
+int peer_fill(Peer *p);
+
+/**
+ * Take the next complete line (or frame) of input, which answers the
+ * outstanding command, and send the next queued command if there is one.
+ *
+ * @param p  The connection.
+ * @param line  Where to store the line, with its newline and a terminating
+ * null, or the frame; at least PEER_BUFSIZE + 1 bytes.
+ * @param cmd  Where to store the first byte of the command answered
+ * (PEER_HELLO for the greeting, 0 if nothing was outstanding).
+ * @return  1 if a line was taken, 0 if no complete line is buffered, or -1
+ * if sending the next command failed.
+ */
+int peer_reply(Peer *p, char *line, int *cmd);
+
+/**
+ * Wait for the next line (or frame) of input and take it, as peer_reply.
+ *
+ * @param p  The connection.
+ * @param line  Where to store the line or frame, as for peer_reply.
+ * @param cmd  Where to store the first byte of the command answered.
+ * @return  1 if a line was taken, or -1 if the child has gone away.
+ */
+int peer_wait(Peer *p, char *line, int *cmd);
+
+/**
+ * Close the pipes of a connection and discard any queued commands.
+ *
+ * @param p  The connection.
+ */
+void peer_close(Peer *p);
+
+#endif /* PEER_H */
@@ -0,0 +1,98 @@
+#ifndef POSITION_H
+#define POSITION_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+
+/*
+ * Compact encodings of a game position, for exchanging positions without
+ * replaying the moves that led to them.
+ *
+ * The binary form packs a position into 16 bytes.  Taken as a 128-bit
+ * little-endian number, bits 0 to 80 say which holes are occupied, the bits
+ * from 81 on give the owner of each occupied hole in turn (1 for O), and
+ * bit 127 is set if O is to move.  The text form is a single word giving
+ * the rows from A to I, each as its holes from 1 to 9 ('W' for X, 'B' for
+ * O, and a digit for a run of empty holes), separated by '/', followed by
+ * '/' and the side to move ('w' or 'b').  The start of a game is
+ *
+ *   WWWW5/WWW6/WW7/W8/9/8B/7BB/6BBB/5BBBB/w
+ *
+ * Each position has exactly one encoding of each form, so either can serve
+ * as a key.  The number of moves played is not part of the position.
+ */
+
+#define POSITION_BYTES 16                 // Size of the binary form
+#define POSITION_TEXT 96                  // Room for the text form, with its null
+#define POSITION_MAXPIECES 46             // Pieces for which there are owner bits
+
+typedef struct position {
+    uint8_t bytes[POSITION_BYTES];
+} Position;
+
+/**
+ * Encode a bitboard, in time proportional to the number of pieces.
+ *
+ * @param bp  The position.
+ * @param pos  Where to store its encoding.
+ * @return  0 if successful, or -1 if it has too many pieces to encode.
+ */
+int bb_encode(const Bitboard *bp, Position *pos);
+
+/**
+ * Set up a bitboard from an encoding, in time proportional to the number of
+ * pieces.
+ *
+ * @param pos  The encoding.
+ * @param bp  The bitboard to be initialized.
+ * @return  0 if successful, or -1 if the encoding is malformed.
+ */
+int bb_decode(const Position *pos, Bitboard *bp);
+
+/**
+ * Encode the position of a library game board.  The board is opaque, so
+ * this reads it back from print_bd, and is no faster than bb_from_board.
+ *
+ * @param bp  The board.
+ * @param pos  Where to store its encoding.
+ * @return  0 if successful, or -1 if the board could not be read.
+ */
+int encode_bd(Board *bp, Position *pos);
+
+/**
+ * Create a library game board in an encoded position, in time proportional
+ * to the number of pieces.  The board is opaque, so it is set up by
+ * applying moves to a new board that lift each piece out of place straight
+ * to where it belongs (apply does not check them), with passes to keep the
+ * turns alternating.  Its move number therefore counts those moves, not the
+ * moves of any game.
+ *
+ * @param pos  The encoding, which must have as many pieces of each side as
+ * the start of a game.
+ * @return  The board, or NULL if the encoding is malformed or has the wrong
+ * number of pieces.
+ */
+Board *decode_bd(const Position *pos);
+
+/**
+ * Print the text form of an encoded position.
+ *
+ * @param pos  The encoding.
+ * @param s  The output stream.
+ * @return  0 if successful, or -1 if the encoding is malformed.
+ */
+int position_print(const Position *pos, FILE *s);
+
+/**
+ * Encode a position given in text form.
+ *
+ * @param text  The text form, which must be all there is of the string.
+ * @param pos  Where to store the encoding.
+ * @return  0 if successful, or -1 if the text is malformed.
+ */
+int position_parse(const char *text, Position *pos);
+
+#endif /* POSITION_H */
@@ -0,0 +1,46 @@
+#ifndef RACE_H
+#define RACE_H
+
+#include "ccheck.h"
+#include "bitboard.h"
+
+/*
+ * Solver for the race at the end of a game.
+ *
+ * Once every piece of one side is further along than every piece of the
+ * other, the two armies have passed each other: a piece moving forward can no
+ * longer meet, block or hop over an opponent piece.  From then on each side is
+ * just looking for the shortest way to bring its own pieces home, which is
+ * solved exactly by IDA* search, one side at a time.
+ *
+ * The solver only considers moves that do not retreat (sideways moves are
+ * allowed), since a retreat could only be of use by reaching back to the
+ * opponent's pieces.  Move counts are exact, and results proven, in that sense.
+ */
+
+#define RACE_MAXLEN 80                    // Longest race the solver will look for, in moves
+
+/**
+ * Determine whether the two sides have passed each other.
+ *
+ * @param bp  The position.
+ * @return  1 if every X piece is further from X's home corner than every O piece,
+ * otherwise 0.
+ */
+int race_detect(const Bitboard *bp);
+
+/**
+ * Find the least number of moves in which one side can bring all its
+ * pieces home, assuming the other side's pieces stay where they are.
+ * The search gives up if stop_search is set.
+ *
+ * @param bp  The position; it does not matter whose turn it is.
+ * @param p  The side to solve for.
+ * @param first  Receives the first move of a shortest race.
+ * @param limit  The number of positions to examine before giving up.
+ * @param ms  Milliseconds from now after which to give up, or 0 for no limit.
+ * @return  The number of moves, or -1 if the search gave up.
+ */
+int race_moves(const Bitboard *bp, Player p, Move *first, long limit, long ms);
+
+#endif /* RACE_H */
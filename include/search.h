@@ -0,0 +1,140 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+#include <signal.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+
+/* Move that passes the turn, used to pad a principal variation once the
+ * game has been decided. */
+#define NULL_MOVE(p) ((Move)(p) << 16)
+
+#define MAXTHREADS 64                     // Upper limit on search_threads
+#define MAXDEPTH 128                      // Upper limit on max_depth
+
+/* Depth in ply beyond which the engine does not deepen, set from the command
+ * line.  Unlike MAXPLY, this may be raised up to MAXDEPTH. */
+extern int max_depth;
+
+/* Number of threads to search with, set from the command line. */
+extern int search_threads;
+
+/* Search algorithms, selected by search_algorithm. */
+#define SEARCH_ALPHABETA 0                // Full-window alpha/beta at every node
+#define SEARCH_PVS 1                      // Principal variation search: null windows
+                                          // after the first move, re-searching as needed
+
+/* Search algorithm to use, set from the command line.  With SEARCH_PVS the
+ * engine also uses aspiration windows around the previous iteration's score. */
+extern int search_algorithm;
+
+/* Outcomes of a search, left in search_status. */
+#define SEARCH_COMPLETE 0                 // Searched to the full depth
+#define SEARCH_PARTIAL 1                  // Stopped; pvar holds the best root move so far
+#define SEARCH_ABORTED 2                  // Stopped before any root move was finished
+                                          // (or found within the window); pvar is unchanged
+
+/* Outcome of the last call to search. */
+extern int search_status;
+
+/* If set, this is called whenever the search checks stop_search, and a
+ * nonzero result stops the search in the same way.  It serves requests that
+ * come some other way than a signal handler, such as messages on a channel. */
+extern int (*search_interrupt)(void);
+
+/* Positions evaluated by the calling thread in the last search. */
+extern long search_nodes;
+
+/* Setting this (e.g. from a signal handler) makes a running search return
+ * within a few thousand nodes.  The search never clears it; the caller must
+ * do so once the request has been dealt with. */
+extern volatile sig_atomic_t stop_search;
+
+/**
+ * Search a game tree to the depth given by the "depth" global variable,
+ * using alpha/beta pruning backed by the transposition table.
+ * The search itself runs on a bitboard copy of the position.
+ * This is a replacement for bestmove with the same conventions for
+ * "depth", "randomized" and the principal variation, except that the score
+ * is returned from the point of view of the player to move, and that depth
+ * may exceed MAXPLY (up to MAXDEPTH).  Per-ply storage is allocated ahead
+ * of time for max_depth ply, so the search itself does not allocate.
+ * The transposition table must have been set up using tt_init, and it is
+ * retained across calls so that results carry over between iterations
+ * and between moves.
+ *
+ * The search stops early if stop_search is set or the deadline set with
+ * search_set_deadline passes; search_status then tells whether pvar holds
+ * a usable result.
+ *
+ * If search_threads is greater than one, helper threads search the same
+ * position alongside the calling thread, sharing only the transposition
+ * table ("lazy SMP").  The helpers block all signals, and are stopped
+ * before search returns.  Only the calling thread touches pvar and the
+ * library's statistics.
+ *
+ * @param bp  The starting board position for the search.
+ * @param p  The player whose turn it is to move in the specified position.
+ * @param pvar  Array that receives the principal variation [0, depth-1].
+ * Coming in, it should hold the previous iteration's principal variation,
+ * which is searched first.
+ * @param alpha  The alpha cutoff threshold (in range [-MAXEVAL, MAXEVAL]).
+ * @param beta  The beta cutoff threshold (in range [-MAXEVAL, MAXEVAL]).
+ * @return  The score of the position for player p.  After a partial search,
+ * this is the score of the best root move found.  As with bestmove, a score
+ * at or below alpha is only an upper bound, and one at or above beta only a
+ * lower bound.
+ */
+int search(Board *bp, Player p, Move *pvar, int alpha, int beta);
+
+/**
+ * Rank the moves available in a position by the score each obtains in a
+ * search to a given depth, as a guide to which are most likely to be played.
+ * Like search, this stops early if stop_search is set or the deadline passes,
+ * and sets search_status accordingly.
+ *
+ * @param bp  The position.
+ * @param d  The depth in ply of the search, counting the move itself.
+ * @param replies  Array that receives the best moves, best first.
+ * @param scores  If not NULL, array that receives their scores, from the point
+ * of view of the player making them.
+ * @param max  The number of entries in replies and scores.
+ * @return  The number of moves stored, or 0 if the search was stopped.
+ */
+int search_replies(Board *bp, int d, Move *replies, int *scores, int max);
+
+/**
+ * Set a time limit for subsequent searches, on the monotonic clock.
+ *
+ * @param ms  Milliseconds from now after which searches stop, or 0 for no limit.
+ */
+void search_set_deadline(long ms);
+
+/**
+ * Print a principal variation to stderr, with the evaluation of the position
+ * it leads to, in the manner of print_pvar but for any depth.
+ *
+ * @param bp  The position at the start of the principal variation.
+ * @param pvar  The principal variation.
+ * @param d  The number of moves in the principal variation.
+ */
+void search_print_pvar(Board *bp, Move *pvar, int d);
+
+/**
+ * Print statistics about the last search (beta cutoffs and how many of them
+ * came from the first move tried, PVS re-searches, threads, helper nodes,
+ * elapsed time) to stderr.
+ */
+void search_print_stats(void);
+
+/**
+ * Get the beta cutoff counts of the last search, as printed by
+ * search_print_stats.
+ *
+ * @param cutoffs  Receives the number of beta cutoffs.
+ * @param first  Receives the number of them made by the first move tried.
+ */
+void search_cutoffs(long *cutoffs, long *first);
+
+#endif /* SEARCH_H */
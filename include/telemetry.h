@@ -0,0 +1,88 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "ccheck.h"
+
+/*
+ * Search telemetry: one record for each iteration of the engine's search,
+ * for gathering statistics over many games.
+ *
+ * Records are JSON objects, one per line, each written with a single write()
+ * so that the engines of several games can append to the same file without
+ * their records mixing, and so that nothing is lost when an engine is killed.
+ * A record has the fields
+ *
+ *   pid           the engine's process ID
+ *   move          the move number of the position searched
+ *   player        the side to move in it ("white" or "black")
+ *   depth         the depth of the iteration
+ *   status        "complete", "partial" or "aborted" (as search_status), or
+ *                 "declined" if the time control did not let it start
+ *   budget        how the time control treated the iteration: "none" if the
+ *                 search was not timed, "start" or "stop" if it was or was
+ *                 not let start, or "ponder" on the opponent's time
+ *   elapsed_ms    time spent on the move when the iteration was decided on
+ *   predicted_ms  its predicted time
+ *   target_ms     the time the move should take
+ *   limit_ms      the time it may not exceed
+ *   score         the score, for the side to move
+ *   nodes, us     the positions evaluated and the time taken, in microseconds
+ *   nps           positions evaluated per second
+ *   stepgens, steps, jumpgens, jumps
+ *                 calls to the step and jump generators and the moves they made
+ *   branching     moves generated per position expanded
+ *   ebf           effective branching factor: the nodes of the iteration over
+ *                 those of the one before, or null if there was none
+ *   cutoffs, first_cutoffs
+ *                 beta cutoffs, and those made by the first move tried
+ *   researches    aspiration window re-searches
+ *   pv            the principal variation (only its first move, after a
+ *                 partial search)
+ *
+ * The time control fields are 0 when budget is "none" or "ponder".  When
+ * telemetry is off, the engine does no more than test telemetry_fd once per
+ * iteration.
+ */
+
+#define BUDGET_NONE 0                     // Search not timed
+#define BUDGET_START 1                    // Predicted to fit in the move's time
+#define BUDGET_STOP 2                     // Predicted not to fit, so not started
+#define BUDGET_PONDER 3                   // On the opponent's time
+
+/* An iteration of the search, as recorded. */
+typedef struct iteration {
+    int depth;
+    int status;                           // search_status, or -1 if declined
+    int budget;                           // BUDGET_*
+    long elapsed_ms, predicted_ms;        // Time control when it was decided on
+    long target_ms, limit_ms;
+    int score;
+    long nodes, us;
+    long stepgens, steptot;               // As in bb_stats, over all the searches
+    long jumpgens, jumptot;
+    long cutoffs, firstcutoffs;
+    int researches;                       // Aspiration re-searches
+} Iteration;
+
+/* Descriptor that records are written to, or -1 if telemetry is off. */
+extern int telemetry_fd;
+
+/**
+ * Turn telemetry on.
+ *
+ * @param path  The file to which records are appended, which may be
+ * /dev/fd/<n> to use a descriptor already open.
+ * @return  0 if successful, or -1 if the file could not be opened.
+ */
+int telemetry_open(const char *path);
+
+/**
+ * Write the record of an iteration.
+ *
+ * @param bp  The position searched.
+ * @param it  The iteration.
+ * @param pv  Its principal variation, which has it->depth moves.
+ */
+void telemetry_iteration(Board *bp, const Iteration *it, const Move *pv);
+
+#endif /* TELEMETRY_H */
@@ -0,0 +1,100 @@
+#ifndef TIMECTL_H
+#define TIMECTL_H
+
+/*
+ * Time control for the engine, in milliseconds on the monotonic clock.
+ *
+ * The engine keeps its own account of the time it has spent on its moves,
+ * from the request for a move to the reply, and allows each move the average
+ * time per move plus whatever it has saved on earlier moves (or less what it
+ * has overspent).  Within a move, a new iteration of the search is only
+ * started if its time, predicted from the node counts of the last few depths
+ * and the measured node rate, fits in what is left.  When the best move
+ * changes between iterations, the move is given extra time to settle.
+ */
+
+#define TC_DEFAULT_EBF 6                  // Branching factor assumed before it is measured
+#define TC_UNSTABLE_EXTRA 50              // Percent added to a move's time when the best move changes
+#define TC_HARD_FACTOR 3                  // Hard limit on a move, in multiples of its target
+
+/* Average time allowed per move in milliseconds, set from the command line.
+ * 0 means the engine searches to depth 1 only. */
+extern long avgtime_ms;
+
+/**
+ * Read the monotonic clock.
+ *
+ * @return  The time in milliseconds since an arbitrary starting point.
+ */
+long clock_ms(void);
+
+/**
+ * Read the monotonic clock to the microsecond, for timing short searches.
+ *
+ * @return  The time in microseconds since an arbitrary starting point.
+ */
+long clock_us(void);
+
+/**
+ * Start the clock for one of the engine's moves and work out its time.
+ */
+void tc_start_move(void);
+
+/**
+ * Stop the clock for one of the engine's moves, charging it with the time used.
+ */
+void tc_end_move(void);
+
+/**
+ * Record the outcome of a completed search, for predicting later ones.
+ *
+ * @param d  The depth searched.
+ * @param nodes  The positions evaluated by the search.
+ * @param ms  The time it took.
+ */
+void tc_record(int d, long nodes, long ms);
+
+/**
+ * Predict the time a search to a given depth will take.
+ *
+ * @param d  The depth.
+ * @return  The predicted time in milliseconds.
+ */
+long tc_predict(int d);
+
+/**
+ * Decide whether to start the next iteration of the search for a move.
+ *
+ * @param d  The depth of the iteration.
+ * @return  1 if it is predicted to finish within the move's time, otherwise 0.
+ */
+int tc_start_iteration(int d);
+
+/**
+ * Time left before the hard limit for the current move, which a search
+ * should not run past.
+ *
+ * @return  The time left in milliseconds (at least 1).
+ */
+long tc_remaining(void);
+
+/**
+ * Note that the best move changed between iterations, giving the move extra time.
+ */
+void tc_best_changed(void);
+
+/**
+ * Get the time used by the current move so far, its target and its limit.
+ *
+ * @param elapsed  Receives the time used, in milliseconds.
+ * @param target  Receives the time it should take.
+ * @param limit  Receives the time it may not exceed.
+ */
+void tc_budget(long *elapsed, long *target, long *limit);
+
+/**
+ * Print the time used by the current move and its target to stderr.
+ */
+void tc_print(void);
+
+#endif /* TIMECTL_H */
@@ -0,0 +1,497 @@
+/*
+ * Bitboard game positions and move generation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+#include "debug.h"
+
+#define ONBOARD ((BIT(NSQUARES)) - 1)     // Every hole on the board
+#define NDIRS 6                           // Neighbors of a hole
+
+// Build a move in the library's encoding
+#define MAKE_MOVE(p, from, to) \
+    (((Move)(p) << 16) | (sqrow[from] << 12) | (sqcol[from] << 8) | (sqrow[to] << 4) | sqcol[to])
+
+Bits home[2];
+_Thread_local BBStats bb_stats;
+
+// Directions, in the same order as the library's rdirect/cdirect tables
+static const int rdir[NDIRS] = { 0, -1, -1, 0, 1, 1 };
+static const int cdir[NDIRS] = { 1, 1, 0, -1, -1, 0 };
+static int delta[NDIRS];                  // Square number offset of each direction
+static Bits stepmask[NDIRS];              // Holes with a neighbor in each direction
+static Bits hopmask[NDIRS];               // Holes with a hole two away in each direction
+static Bits swapzone[2];                  // Where a step may swap with an opponent piece
+static int sqrow[NSQUARES], sqcol[NSQUARES];
+static int progress[NSQUARES];            // Evaluation terms of a piece on each hole
+static int spread[NSQUARES];
+static int base_progress;                 // Sum of both sides' progress at the start
+static int weight[2][NSQUARES];           // What a piece of each side on each hole adds to the score
+
+static void bb_init() {
+    static int initialized = 0;
+    if (initialized) {
+        return;
+    }
+    hash_init();
+    for (int sq = 0; sq < NSQUARES; sq++) {
+        int r = sq / BOARD_SIZE, c = sq % BOARD_SIZE;
+        sqrow[sq] = r;
+        sqcol[sq] = c;
+        progress[sq] = r + c;
+        spread[sq] = abs(r - c);
+        // Each side starts in the triangle of ten holes in its corner
+        if (r + c <= 3) {
+            home[X] |= BIT(sq);
+        }
+        if (r + c >= 2 * (BOARD_SIZE - 1) - 3) {
+            home[O] |= BIT(sq);
+        }
+        if (home[X] & BIT(sq) || home[O] & BIT(sq)) {
+            base_progress += progress[sq];
+        }
+        // A piece may swap with an opponent piece occupying its target area
+        if (r + c > 11) {
+            swapzone[X] |= BIT(sq);
+        }
+        if (r + c <= 4) {
+            swapzone[O] |= BIT(sq);
+        }
+        for (int d = 0; d < NDIRS; d++) {
+            int r1 = r + rdir[d], c1 = c + cdir[d];
+            int r2 = r1 + rdir[d], c2 = c1 + cdir[d];
+            if (r1 >= 0 && r1 < BOARD_SIZE && c1 >= 0 && c1 < BOARD_SIZE) {
+                stepmask[d] |= BIT(sq);
+            }
+            if (r2 >= 0 && r2 < BOARD_SIZE && c2 >= 0 && c2 < BOARD_SIZE) {
+                hopmask[d] |= BIT(sq);
+            }
+        }
+    }
+    for (int d = 0; d < NDIRS; d++) {
+        delta[d] = rdir[d] * BOARD_SIZE + cdir[d];
+    }
+    // Progress toward the far corner counts most; staying near the long
+    // diagonal (row == column) breaks ties, as in eval
+    for (int sq = 0; sq < NSQUARES; sq++) {
+        weight[X][sq] = 100 * progress[sq] - spread[sq];
+        weight[O][sq] = 100 * progress[sq] + spread[sq];
+    }
+    initialized = 1;
+}
+
+static inline Bits shift(Bits b, int d) {
+    return d > 0 ? b << d : b >> -d;
+}
+
+static HashKey bb_hash(const Bitboard *bp) {
+    HashKey key = bp->tomove == O ? zobrist_side : 0;
+    for (int p = 0; p < 2; p++) {
+        for (Bits b = bp->pieces[p]; b != 0; b &= b - 1) {
+            key ^= zobrist[p][first_square(b)];
+        }
+    }
+    return key;
+}
+
+// The score for X, from scratch
+static int bb_score(const Bitboard *bp) {
+    int score = -100 * base_progress;
+    for (int p = 0; p < 2; p++) {
+        for (Bits b = bp->pieces[p]; b != 0; b &= b - 1) {
+            score += weight[p][first_square(b)];
+        }
+    }
+    return score;
+}
+
+// The accumulator of nnue_net, from scratch
+static void bb_accumulate(const Bitboard *bp, int16_t *acc) {
+    int features[NNUE_FEATURES], n = 0;
+    for (int p = 0; p < 2; p++) {
+        for (Bits b = bp->pieces[p]; b != 0; b &= b - 1) {
+            features[n++] = p * NSQUARES + first_square(b);
+        }
+    }
+    nnue_refresh(acc, features, n);
+}
+
+// Work out the running sums of a position set up from scratch
+static void bb_refresh(Bitboard *bp) {
+    bp->key = bb_hash(bp);
+    bp->score = bb_score(bp);
+    if (nnue_net != NULL) {
+        bb_accumulate(bp, bp->acc);
+    }
+}
+
+void bb_newbd(Bitboard *bp)
+{
+    bb_init();
+    bp->pieces[X] = home[X];
+    bp->pieces[O] = home[O];
+    bp->tomove = X;
+    bp->moveno = 0;
+    bb_refresh(bp);
+}
+
+void bb_setup(Bitboard *bp, Bits white, Bits black, Player tomove)
+{
+    bb_init();
+    bp->pieces[X] = white;
+    bp->pieces[O] = black;
+    bp->tomove = tomove;
+    bp->moveno = tomove == X ? 0 : 1;
+    bb_refresh(bp);
+}
+
+int bb_from_board(Board *obp, Bitboard *bp)
+{
+    bb_init();
+    char *buf = NULL;
+    size_t len = 0;
+    FILE *s = open_memstream(&buf, &len);
+    if (s == NULL) {
+        return -1;
+    }
+    print_bd(obp, s);
+    fclose(s);
+
+    // The board is opaque, so read it back from its printed form, in which
+    // each row is its letter followed by one token per hole,
+    // e.g. "   D W - - - - - - - -"; any other line is ignored.
+    bp->pieces[X] = bp->pieces[O] = 0;
+    int rows = 0;
+    for (char *line = strtok(buf, "\n"); line != NULL; line = strtok(NULL, "\n")) {
+        while (*line == ' ') {
+            line++;
+        }
+        if (line[0] < 'A' || line[0] >= 'A' + BOARD_SIZE || line[1] != ' ') {
+            continue;
+        }
+        int row = line[0] - 'A';
+        int col = 0;
+        for (char *cp = line + 1; *cp != '\0' && col < BOARD_SIZE; cp++) {
+            if (*cp == ' ') {
+                continue;
+            }
+            if (*cp == 'W') {
+                bp->pieces[X] |= BIT(row * BOARD_SIZE + col);
+            } else if (*cp == 'B') {
+                bp->pieces[O] |= BIT(row * BOARD_SIZE + col);
+            } else if (*cp != '-') {
+                break;
+            }
+            col++;
+        }
+        if (col == BOARD_SIZE) {
+            rows++;
+        }
+    }
+    free(buf);
+
+    bp->tomove = player_to_move(obp);
+    bp->moveno = move_number(obp);
+    bb_refresh(bp);
+    return rows == BOARD_SIZE ? 0 : -1;
+}
+
+void bb_apply(Bitboard *bp, Move m)
+{
+    Player p = bp->tomove;
+    int from = SQ_FROM(m), to = SQ_TO(m);
+    bp->key ^= zobrist_side;
+    bp->tomove = 1 - p;
+    bp->moveno++;
+    if (from == to) {
+        return;
+    }
+
+    Bits change = BIT(from) | BIT(to);
+    // Stepping onto an opponent piece in the target area swaps the two
+    if (bp->pieces[1 - p] & BIT(to)) {
+        bp->pieces[1 - p] ^= change;
+        bp->key ^= zobrist[1 - p][to] ^ zobrist[1 - p][from];
+        bp->score += weight[1 - p][from] - weight[1 - p][to];
+        if (nnue_net != NULL) {
+            nnue_move(bp->acc, 1 - p, to, from);
+        }
+    }
+    bp->pieces[p] ^= change;
+    bp->key ^= zobrist[p][from] ^ zobrist[p][to];
+    bp->score += weight[p][to] - weight[p][from];
+    if (nnue_net != NULL) {
+        nnue_move(bp->acc, p, from, to);
+    }
+}
+
+void bb_undo(Bitboard *bp, Move m)
+{
+    Player p = 1 - bp->tomove;
+    int from = SQ_FROM(m), to = SQ_TO(m);
+    bp->key ^= zobrist_side;
+    bp->tomove = p;
+    bp->moveno--;
+    if (from == to) {
+        return;
+    }
+
+    Bits change = BIT(from) | BIT(to);
+    if (bp->pieces[1 - p] & BIT(from)) {
+        bp->pieces[1 - p] ^= change;
+        bp->key ^= zobrist[1 - p][to] ^ zobrist[1 - p][from];
+        bp->score += weight[1 - p][to] - weight[1 - p][from];
+        if (nnue_net != NULL) {
+            nnue_move(bp->acc, 1 - p, from, to);
+        }
+    }
+    bp->pieces[p] ^= change;
+    bp->key ^= zobrist[p][from] ^ zobrist[p][to];
+    bp->score += weight[p][from] - weight[p][to];
+    if (nnue_net != NULL) {
+        nnue_move(bp->acc, p, to, from);
+    }
+}
+
+int bb_step_moves(const Bitboard *bp, Move *list)
+{
+    Player p = bp->tomove;
+    Bits own = bp->pieces[p], opp = bp->pieces[1 - p];
+    Bits open = (ONBOARD & ~(own | opp)) | (opp & swapzone[p]);
+    int n = 0;
+
+    // One shift per direction finds the steps of every piece at once
+    for (int d = 0; d < NDIRS; d++) {
+        Bits to = shift(own & stepmask[d], delta[d]) & open;
+        for (; to != 0; to &= to - 1) {
+            int sq = first_square(to);
+            list[n++] = MAKE_MOVE(p, sq - delta[d], sq);
+        }
+    }
+    bb_stats.stepgens++;
+    bb_stats.steptot += n;
+    return n;
+}
+
+// Holes reachable from the holes in "frontier" by a single hop over an occupied hole,
+// taken in direction d.
+static inline Bits hop(Bits frontier, Bits occupied, int d) {
+    return shift(shift(frontier & hopmask[d], delta[d]) & occupied, delta[d]);
+}
+
+int bb_jump_moves(const Bitboard *bp, Move *list)
+{
+    Player p = bp->tomove;
+    Bits own = bp->pieces[p];
+    Bits occupied = own | bp->pieces[1 - p];
+    Bits empty = ONBOARD & ~occupied;
+    int n = 0;
+
+    // Flood fill outward from each piece, one hop per round for the whole
+    // frontier at once.  A hole already reached is never entered again, so
+    // every destination is generated exactly once however many chains lead there.
+    for (Bits b = own; b != 0; b &= b - 1) {
+        int from = first_square(b);
+        Bits reached = 0;
+        for (Bits frontier = BIT(from); frontier != 0; ) {
+            Bits next = 0;
+            for (int d = 0; d < NDIRS; d++) {
+                next |= hop(frontier, occupied, d);
+            }
+            frontier = next & empty & ~reached;
+            reached |= frontier;
+        }
+        for (; reached != 0; reached &= reached - 1) {
+            list[n++] = MAKE_MOVE(p, from, first_square(reached));
+        }
+    }
+    bb_stats.jumpgens++;
+    bb_stats.jumptot += n;
+    return n;
+}
+
+int bb_legal(const Bitboard *bp, Move m)
+{
+    Player p = bp->tomove;
+    int from = SQ_FROM(m), to = SQ_TO(m);
+    Bits own = bp->pieces[p], opp = bp->pieces[1 - p];
+    if (((m >> 16) & 1) != p || !(own & BIT(from)) || from == to) {
+        return 0;
+    }
+
+    // A step, under the same rules as bb_step_moves
+    Bits open = (ONBOARD & ~(own | opp)) | (opp & swapzone[p]);
+    for (int d = 0; d < NDIRS; d++) {
+        if ((stepmask[d] & BIT(from)) && from + delta[d] == to) {
+            return (open & BIT(to)) != 0;
+        }
+    }
+
+    // A jump: the flood fill of bb_jump_moves, for this piece alone
+    Bits occupied = own | opp;
+    Bits empty = ONBOARD & ~occupied;
+    Bits reached = 0;
+    for (Bits frontier = BIT(from); frontier != 0 && !(reached & BIT(to)); ) {
+        Bits next = 0;
+        for (int d = 0; d < NDIRS; d++) {
+            next |= hop(frontier, occupied, d);
+        }
+        frontier = next & empty & ~reached;
+        reached |= frontier;
+    }
+    return (reached & BIT(to)) != 0;
+}
+
+int bb_jump_path(const Bitboard *bp, Move m, int *path)
+{
+    int from = SQ_FROM(m), to = SQ_TO(m);
+    Bits occupied = bp->pieces[X] | bp->pieces[O];
+    Bits empty = ONBOARD & ~occupied;
+    Bits reached = 0;
+    unsigned char parent[NSQUARES];
+
+    // The same flood fill as bb_jump_moves, recording where each hole was
+    // first reached from; rounds go one hop at a time, so the path is shortest.
+    for (Bits frontier = BIT(from); frontier != 0 && !(reached & BIT(to)); ) {
+        Bits next = 0;
+        for (int d = 0; d < NDIRS; d++) {
+            Bits found = hop(frontier, occupied, d) & empty & ~reached & ~next;
+            for (Bits f = found; f != 0; f &= f - 1) {
+                int sq = first_square(f);
+                parent[sq] = sq - 2 * delta[d];
+            }
+            next |= found;
+        }
+        frontier = next;
+        reached |= next;
+    }
+    if (from == to || !(reached & BIT(to))) {
+        return 0;
+    }
+
+    int n = 0;
+    for (int sq = to; sq != from; sq = parent[sq]) {
+        path[n++] = sq;
+    }
+    path[n++] = from;
+    // Reverse, so that the path reads from origin to destination
+    for (int i = 0, j = n - 1; i < j; i++, j--) {
+        int t = path[i];
+        path[i] = path[j];
+        path[j] = t;
+    }
+    return n;
+}
+
+void bb_print_move(const Bitboard *bp, Move m, FILE *s)
+{
+    int path[NSQUARES];
+    int n = bb_jump_path(bp, m, path);
+    if (n == 0) {
+        // A step (or null move) is just its two end points
+        path[0] = SQ_FROM(m);
+        path[1] = SQ_TO(m);
+        n = 2;
+    }
+    fprintf(s, "%s:", ((m >> 16) & 1) == X ? "white" : "black");
+    for (int i = 0; i < n; i++) {
+        fprintf(s, "%s%c%d", i > 0 ? "-" : "", 'A' + sqrow[path[i]], sqcol[path[i]] + 1);
+    }
+}
+
+Move bb_parse_move(const Bitboard *bp, const char *text)
+{
+    Player p;
+    if (strncmp(text, "white:", 6) == 0) {
+        p = X;
+    } else if (strncmp(text, "black:", 6) == 0) {
+        p = O;
+    } else {
+        return 0;
+    }
+    if (p != bp->tomove) {
+        return 0;
+    }
+    // Two or more holes joined by '-'; only the first and last matter here
+    int from = -1, to = -1;
+    for (text += 6; ; text++) {
+        int r = text[0] - 'A', c = text[1] - '1';
+        if (r < 0 || r >= BOARD_SIZE || c < 0 || c >= BOARD_SIZE) {
+            return 0;
+        }
+        to = r * BOARD_SIZE + c;
+        if (from == -1) {
+            from = to;
+        }
+        text += 2;
+        if (*text != '-') {
+            break;
+        }
+    }
+    if (to == from || (*text != '\0' && !isspace((unsigned char)*text))) {
+        return 0;
+    }
+    return MAKE_MOVE(p, from, to);
+}
+
+int bb_moves(const Bitboard *bp, Move *list)
+{
+    int n = bb_jump_moves(bp, list);
+    return n + bb_step_moves(bp, list + n);
+}
+
+int bb_game_over(const Bitboard *bp)
+{
+    if (bp->pieces[X] == home[O]) {
+        return 1;
+    }
+    if (bp->pieces[O] == home[X]) {
+        return -1;
+    }
+    return 0;
+}
+
+int bb_eval(const Bitboard *bp, Player p)
+{
+    int score;
+    bb_stats.nodes++;
+    if (bp->pieces[X] == home[O]) {
+        score = WINEVAL;
+    } else if (bp->pieces[O] == home[X]) {
+        score = -WINEVAL;
+    } else {
+#ifdef DEBUG
+        if (bp->score != bb_score(bp)) {
+            fprintf(stderr, "Running score %d of position with key %016llx should be %d\n", bp->score,
+                    (unsigned long long)bp->key, bb_score(bp));
+            abort();
+        }
+        if (nnue_net != NULL) {
+            int16_t acc[NNUE_HIDDEN];
+            bb_accumulate(bp, acc);
+            if (memcmp(acc, bp->acc, sizeof(acc)) != 0) {
+                fprintf(stderr, "Accumulator of position with key %016llx is out of date\n",
+                        (unsigned long long)bp->key);
+                abort();
+            }
+        }
+#endif
+        score = bp->score;
+        if (nnue_net != NULL) {
+            score += nnue_output(bp->acc, bp->tomove);
+            // Short of a win, however sure the network is
+            if (score >= WINEVAL) {
+                score = WINEVAL - 1;
+            } else if (score <= -WINEVAL) {
+                score = -(WINEVAL - 1);
+            }
+        }
+    }
+    return p == X ? score : -score;
+}
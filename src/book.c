@@ -0,0 +1,148 @@
+/*
+ * Memory-mapped opening book
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ccheck.h"
+#include "book.h"
+#include "debug.h"
+
+char *book_file = NULL;
+
+static void *map = NULL;                  // The whole file, as mapped
+static size_t map_size;
+static const BookEntry *entries;          // Entries within the mapping
+static size_t nentries;
+
+int book_open(const char *path)
+{
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1 || (size_t)st.st_size < sizeof(BookHeader)) {
+        close(fd);
+        return -1;
+    }
+    // Shared and read-only, so every process mapping the book uses the same pages
+    void *m = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        return -1;
+    }
+
+    const BookHeader *hdr = m;
+    if (memcmp(hdr->magic, BOOK_MAGIC, sizeof(hdr->magic)) != 0
+        || hdr->count > (st.st_size - sizeof(BookHeader)) / sizeof(BookEntry)) {
+        munmap(m, st.st_size);
+        return -1;
+    }
+    // Lookups touch only a few pages; reading ahead would fetch the whole book
+    madvise(m, st.st_size, MADV_RANDOM);
+
+    if (map != NULL) {
+        munmap(map, map_size);
+    }
+    map = m;
+    map_size = st.st_size;
+    entries = (const BookEntry *)(hdr + 1);
+    nentries = hdr->count;
+    debug("Book %s: %zu entries", path, nentries);
+    return 0;
+}
+
+int book_probe(const Bitboard *bp, Move *m)
+{
+    if (map == NULL) {
+        return 0;
+    }
+
+    // Find the first entry for the position
+    size_t lo = 0, hi = nentries;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (entries[mid].key < bp->key) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+
+    Move legal[MAXMOVES];
+    int nlegal = bb_moves(bp, legal);
+    Move best = 0;
+    unsigned long total = 0;
+    uint32_t most = 0;
+    for (size_t i = lo; i < nentries && entries[i].key == bp->key; i++) {
+        const BookEntry *e = &entries[i];
+        int ok = 0;
+        for (int j = 0; j < nlegal && !ok; j++) {
+            ok = legal[j] == (Move)e->move;
+        }
+        if (!ok || e->weight == 0) {
+            continue;
+        }
+        if (randomized) {
+            // Reservoir choice: each move wins with probability weight / total
+            total += e->weight;
+            if ((unsigned long)random() % total < e->weight) {
+                best = e->move;
+            }
+        } else if (e->weight > most) {
+            most = e->weight;
+            best = e->move;
+        }
+    }
+    if (best == 0) {
+        return 0;
+    }
+    *m = best;
+    return 1;
+}
+
+static int compare_entries(const void *a, const void *b) {
+    const BookEntry *x = a, *y = b;
+    if (x->key != y->key) {
+        return x->key < y->key ? -1 : 1;
+    }
+    if (x->move != y->move) {
+        return x->move < y->move ? -1 : 1;
+    }
+    return 0;
+}
+
+long book_write(const char *path, BookEntry *list, size_t n)
+{
+    qsort(list, n, sizeof(BookEntry), compare_entries);
+    size_t count = 0;
+    for (size_t i = 0; i < n; i++) {
+        if (count > 0 && list[count - 1].key == list[i].key && list[count - 1].move == list[i].move) {
+            list[count - 1].weight += list[i].weight;
+        } else {
+            list[count++] = list[i];
+        }
+    }
+
+    FILE *f = fopen(path, "w");
+    if (f == NULL) {
+        return -1;
+    }
+    BookHeader hdr = { BOOK_MAGIC, count };
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1
+        || fwrite(list, sizeof(BookEntry), count, f) != count) {
+        fclose(f);
+        return -1;
+    }
+    if (fclose(f) == EOF) {
+        return -1;
+    }
+    return count;
+}
@@ -1,21 +1,41 @@
 #include <stdlib.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <unistd.h>
 #include <signal.h>
 #include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
 #include <string.h>
 #include <errno.h>
 
 #include "ccheck.h"
+#include "engine.h"
+#include "peer.h"
+#include "frame.h"
+#include "bitboard.h"
+#include "gamelog.h"
+#include "position.h"
+#include "timectl.h"
 #include "debug.h"
 
 // Define NO_PLAYER since it's not in the header
 #define NO_PLAYER ((Player)-1)
 
+#define MAX_EVENTS 8                      // Events taken from epoll_wait at a time
+
+// What each descriptor watched by the event loop is
+#define EV_SIGNAL 1                       // The signalfd
+#define EV_DISPLAY 2                      // The pipe from the display
+#define EV_ENGINE 3                       // The pipe from the engine process
+#define EV_THREAD 4                       // The eventfd announcing replies from the engine thread
+
 // Define global variable verbose (defined here instead of in library)
 int verbose = 0;
 
-// Global variables for signal handling
+// Global variables for signal handling (the handlers only run while the
+// terminal is being read; otherwise signals are taken from a signalfd)
 static volatile sig_atomic_t sigchld_received = 0;
 static volatile sig_atomic_t sigint_received = 0;
 static volatile sig_atomic_t sighup_received = 0;
@@ -25,6 +45,32 @@ static volatile sig_atomic_t sigterm_received = 0;
 static pid_t display_pid = 0;
 static pid_t engine_pid = 0;
 
+// Move number of the starting position, less one if black moves first, so
+// that a game started from a position (-p) is numbered from 1
+static int first_move = 0;
+
+// State of the game in progress, shared by the handlers of the event loop
+typedef struct game {
+    Board *board;
+    Bitboard bb;                          // The same position, for frames and legality checks
+    MoveSet legal;                        // Legal moves, for checking the engine's frames
+    Player engine_player;
+    int tournament_mode;
+    int no_display;
+    int engine_thread;
+    FILE *transcript;
+    GameLog *log;                         // Binary game log, if any
+    long asked_at;                        // When the move being waited for was asked for
+    Peer display;                         // The display process (display.in is -1 if none)
+    Peer engine;                          // The engine process (engine.in is -1 if none)
+    Channel commands, replies;            // Or the engine thread
+    pthread_t engine_tid;
+    int from_stdin;                       // The next move is to be read from stdin
+    int over;                             // The game has been won
+    int done;                             // The event loop should stop
+    int error;                            // ... because something went wrong
+} Game;
+
 // Signal handlers
 static void sigchld_handler(int sig) {
     sigchld_received = 1;
@@ -58,6 +104,285 @@ static void cleanup_processes() {
     }
 }
 
+// Log a move to the transcript (after apply(), so move_num has been incremented)
+static void log_move(FILE *transcript, Board *board, Player player, const char *text) {
+    int move_num = move_number(board) - first_move;
+    if (player == X) {
+        // White move: move_num will be odd (1,3,5...), display as (1,2,3...)
+        fprintf(transcript, "%d. ", (move_num / 2) + 1);
+    } else {
+        // Black move: move_num will be even (2,4,6...), display as (1,2,3...)
+        fprintf(transcript, "%d. ... ", move_num / 2);
+    }
+    fprintf(transcript, "%s\n", text);
+}
+
+// Format a move as text, e.g. "white:B3-B4", from the hops in a frame if
+// there is one that has them, and otherwise as print_move does
+static void move_text(char *text, size_t size, Board *board, Move move, const Frame *f) {
+    FILE *s = fmemopen(text, size, "w");
+    if (f == NULL || frame_print_move(f, s) == -1) {
+        print_move(board, move, s);
+    }
+    fclose(s);
+}
+
+// Read a move from a reply line, which is checked as read_move_from_pipe does
+static Move parse_move(Board *board, char *line) {
+    FILE *s = fmemopen(line, strlen(line), "r");
+    Move move = read_move_from_pipe(s, board);
+    fclose(s);
+    return move;
+}
+
+// A child has gone away; that ends the game, but is only an error if the
+// game is not yet over
+static void peer_died(Game *g, Peer *p) {
+    g->done = 1;
+    if (g->over) {
+        return;
+    }
+    if (p->awaiting == PEER_HELLO) {
+        fprintf(stderr, "%s process failed to initialize\n", p->name);
+    } else {
+        fprintf(stderr, "%s died\n", p->name);
+    }
+    g->error = 1;
+}
+
+// Append a move to the game log; if that fails, the log is given up on
+// rather than the game
+static void write_log(Game *g, const LogRecord *rec) {
+    if (gamelog_move(g->log, rec) == -1) {
+        perror("game log");
+        gamelog_close(g->log);
+        g->log = NULL;
+    }
+}
+
+// Ask whoever is to move next for their move
+static void request_move(Game *g) {
+    g->asked_at = clock_ms();
+    if (player_to_move(g->board) == g->engine_player) {
+        if (g->engine_thread) {
+            channel_send(&g->commands, (Message){ MSG_REQUEST, 0 });
+        } else if (g->engine.framed) {
+            Frame f;
+            frame_make(&f, MSG_REQUEST, &g->bb, 0);
+            if (peer_send_frame(&g->engine, &f) == -1) {
+                peer_died(g, &g->engine);
+                return;
+            }
+            // Gather the legal moves while the engine thinks, so that
+            // checking the one it sends is a lookup
+            moveset_fill(&g->legal, &g->bb);
+        } else if (peer_send(&g->engine, "<\n") == -1) {
+            peer_died(g, &g->engine);
+        }
+    } else if (g->display.in != -1 && !g->tournament_mode) {
+        // Interactive mode with display - request move from display
+        if (peer_send(&g->display, "<\n") == -1) {
+            peer_died(g, &g->display);
+        }
+    } else {
+        // Interactive mode from stdin
+        g->from_stdin = 1;
+    }
+}
+
+// Make a move, pass it on to the display and the engine without waiting for
+// either to acknowledge it, and ask for the next one.  The frame the move
+// came in, if any, gives the hops to show and what the engine's search found.
+static void play_move(Game *g, Move move, const Frame *f) {
+    long ms = clock_ms() - g->asked_at;
+    Player current_player = player_to_move(g->board);
+    int tell_engine = current_player != g->engine_player && g->engine_player != NO_PLAYER;
+
+    // Charge the player for time
+    setclock(current_player);
+
+    char text[PEER_BUFSIZE - 2];
+    move_text(text, sizeof(text), g->board, move, f);
+    Frame opponent;
+    if (tell_engine && g->engine.framed) {
+        frame_make(&opponent, MSG_OPPONENT, &g->bb, move);
+    }
+    apply(g->board, move);
+    bb_apply(&g->bb, move);
+
+    // Print move - in tournament mode, prefix computer moves with @@@
+    if (g->tournament_mode && current_player == g->engine_player) {
+        printf("@@@");
+    }
+    printf("%s\n", text);
+    fflush(stdout);
+
+    // Update display if active
+    char cmd[PEER_BUFSIZE + 1];
+    snprintf(cmd, sizeof(cmd), ">%s\n", text);
+    if (g->display.in != -1 && peer_send(&g->display, cmd) == -1) {
+        peer_died(g, &g->display);
+        return;
+    }
+
+    // Print board if no display
+    if (g->no_display) {
+        print_bd(g->board, stdout);
+    }
+
+    if (g->transcript) {
+        log_move(g->transcript, g->board, current_player, text);
+        fflush(g->transcript);
+    }
+
+    if (g->log) {
+        LogRecord rec = { .move = move, .ms = ms };
+        if (current_player == g->engine_player) {
+            rec.flags = LOG_ENGINE;
+        }
+        if (f != NULL) {
+            rec.depth = f->depth;
+            rec.score = f->score;
+            rec.nodes = f->nodes;
+        }
+        write_log(g, &rec);
+    }
+
+    // Send move to engine if it's the opponent's move
+    if (tell_engine) {
+        if (g->engine_thread) {
+            channel_send(&g->commands, (Message){ MSG_OPPONENT, move });
+        } else if (g->engine.framed ? peer_send_frame(&g->engine, &opponent) == -1
+                                    : peer_send(&g->engine, cmd) == -1) {
+            peer_died(g, &g->engine);
+            return;
+        }
+    }
+
+    // Check if game is over; if so, wait for a termination signal
+    int winner = game_over(g->board);
+    if (winner != 0) {
+        if (winner == 1) {
+            printf("White wins!\n");
+        } else {
+            printf("Black wins!\n");
+        }
+        g->over = 1;
+        if (g->log && gamelog_result(g->log, winner) == -1) {
+            perror("game log");
+        }
+        return;
+    }
+    request_move(g);
+}
+
+// Take the replies a child has sent: moves asked for are played, and
+// acknowledgements need nothing more than to be taken
+static void peer_input(Game *g, Peer *p) {
+    int eof = peer_fill(p) == -1;
+    char line[PEER_BUFSIZE + 1];
+    int cmd, r = 0;
+    while (!g->done && (r = peer_reply(p, line, &cmd)) == 1) {
+        if (p->framed) {
+            // Only the engine sends frames, and only a move needs anything done
+            Frame f;
+            memcpy(&f, line, FRAME_SIZE);
+            if (cmd != MSG_REQUEST || g->over) {
+                continue;
+            }
+            if (f.type != MSG_MOVE || !moveset_legal(&g->legal, &g->bb, f.move)) {
+                fprintf(stderr, "Engine sent an illegal move\n");
+                g->done = g->error = 1;
+                return;
+            }
+            play_move(g, f.move, &f);
+        } else if (cmd == '<' && !g->over) {
+            Move move = parse_move(g->board, line);
+            if (move == 0) {
+                r = -1;
+                break;
+            }
+            play_move(g, move, NULL);
+        }
+    }
+    if (!g->done && (eof || r == -1)) {
+        peer_died(g, p);
+    }
+}
+
+// Take the replies the engine thread has sent
+static void thread_input(Game *g, int efd) {
+    uint64_t count;
+    if (read(efd, &count, sizeof(count)) == -1 && errno != EAGAIN) {
+        perror("read eventfd");
+    }
+    while (!g->done && channel_pending(&g->replies)) {
+        Message msg = channel_receive(&g->replies);
+        if (msg.type == MSG_MOVE && !g->over) {
+            // Framed as the engine process would have sent it
+            Frame f;
+            frame_make(&f, MSG_MOVE, &g->bb, msg.move);
+            f.depth = msg.depth;
+            f.score = msg.score;
+            f.nodes = msg.nodes;
+            play_move(g, msg.move, &f);
+        }
+    }
+}
+
+static void handle_signal(Game *g, int sig) {
+    switch (sig) {
+        case SIGINT:
+            g->done = 1;
+            break;
+        case SIGPIPE:
+        case SIGTERM:
+            g->done = g->error = 1;
+            break;
+        case SIGCHLD: {
+            // Once the game is over, the display being closed ends the program
+            pid_t pid;
+            while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+                if (pid != display_pid && pid != engine_pid) {
+                    continue;
+                }
+                if (pid == display_pid) {
+                    display_pid = 0;
+                } else {
+                    engine_pid = 0;
+                }
+                g->done = 1;
+                if (!g->over) {
+                    fprintf(stderr, "Child process died unexpectedly\n");
+                    g->error = 1;
+                }
+            }
+            break;
+        }
+    }
+}
+
+// Act on the signals the handlers caught while they were unblocked
+static void handle_caught_signals(Game *g) {
+    if (sigchld_received) {
+        sigchld_received = 0;
+        handle_signal(g, SIGCHLD);
+    }
+    if (sigint_received) {
+        sigint_received = 0;
+        handle_signal(g, SIGINT);
+    }
+    if (sigpipe_received || sigterm_received) {
+        sigpipe_received = sigterm_received = 0;
+        handle_signal(g, SIGTERM);
+    }
+}
+
+static int watch(int epfd, int fd, int what) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.u32 = what };
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev);
+}
+
 /*
  * Options (see the assignment document for details):
  *   -w           play white
@@ -66,9 +391,23 @@ static void cleanup_processes() {
  *   -v           give info about search
  *   -d           don't try to use X window system display
  *   -t           tournament mode
- *   -a <num>     set average time per move (in seconds)
+ *   -a <num>     set average time per move (in seconds, e.g. 0.1)
  *   -i <file>    initialize from saved game score
+ *   -p <pos>     start from a position, in the text form of position.h
  *   -o <file>    specify transcript file name
+ *   -L <file>    append the game to a binary game log (see gamelog.h)
+ *   -I           run the engine as a thread of this process
+ *   -H <num>     set engine hash table size (in megabytes)
+ *   -R <policy>  set hash table replacement policy ("depth" or "always")
+ *   -T <num>     set number of engine search threads
+ *   -D <num>     set maximum engine search depth (in ply)
+ *   -S <search>  set engine search algorithm ("alphabeta" or "pvs")
+ *   -B <file>    specify engine opening book file
+ *   -P           don't let the engine think on the opponent's time
+ *   -M <file>    append a record of each engine search iteration to a file
+ *   -N <file>    correct the engine's evaluation with a network file
+ * (the engine options -r, -a, -H, -R, -T, -D, -S, -B, -P, -M and -N are
+ * handled by engine_option)
  */
 
 int ccheck(int argc, char *argv[])
@@ -79,10 +418,13 @@ int ccheck(int argc, char *argv[])
     int tournament_mode = 0;
     char *init_file = NULL;
     char *output_file = NULL;
+    char *log_file = NULL;
+    char *start_text = NULL;
     FILE *transcript = NULL;
+    int engine_thread = 0;
 
     // Parse command-line arguments
-    while((option = getopt(argc, argv, "wbrvdta:i:o:")) != -1){
+    while((option = getopt(argc, argv, "wbvdti:o:IL:p:" ENGINE_OPTIONS)) != -1){
         switch(option){
             case 'w':
                 engine_player = X;
@@ -90,9 +432,6 @@ int ccheck(int argc, char *argv[])
             case 'b':
                 engine_player = O;
                 break;
-            case 'r':
-                randomized = 1;
-                break;
             case 'v':
                 verbose = 1;
                 break;
@@ -102,15 +441,21 @@ int ccheck(int argc, char *argv[])
             case 't':
                 tournament_mode = 1;
                 break;
-            case 'a':
-                avgtime = atoi(optarg);
-                break;
             case 'i':
                 init_file = optarg;
                 break;
             case 'o':
                 output_file = optarg;
                 break;
+            case 'L':
+                log_file = optarg;
+                break;
+            case 'p':
+                start_text = optarg;
+                break;
+            case 'I':
+                engine_thread = 1;
+                break;
             case ':':
                 fprintf(stderr, "Option -%c requires an argument.\n", optopt);
                 exit(EXIT_FAILURE);
@@ -118,10 +463,56 @@ int ccheck(int argc, char *argv[])
                 fprintf(stderr, "Unknown option: -%c.\n", optopt);
                 exit(EXIT_FAILURE);
             default:
+                if (engine_option(option, optarg) == -1) {
+                    exit(EXIT_FAILURE);
+                }
                 break;
         }
     }
 
+    // The starting position: the one given, or the one named on the first
+    // line of a saved game that started from a position of its own
+    Position start;
+    int from_position = 0;
+    if (start_text) {
+        if (position_parse(start_text, &start) == -1) {
+            fprintf(stderr, "Bad position: %s\n", start_text);
+            exit(EXIT_FAILURE);
+        }
+        from_position = 1;
+    }
+    FILE *init = NULL;
+    if (init_file) {
+        init = fopen(init_file, "r");
+        if (!init) {
+            perror("fopen init file");
+            exit(EXIT_FAILURE);
+        }
+        char token[POSITION_TEXT];
+        if (fscanf(init, "%95s", token) == 1 && strcmp(token, "position") == 0) {
+            if (fscanf(init, "%95s", token) != 1 || position_parse(token, &start) == -1) {
+                fprintf(stderr, "Bad position in %s\n", init_file);
+                exit(EXIT_FAILURE);
+            }
+            from_position = 1;
+        } else {
+            rewind(init);
+        }
+    }
+    Board *start_board = from_position ? decode_bd(&start) : newbd();
+    if (start_board == NULL) {
+        fprintf(stderr, "A position must have ten pieces of each side\n");
+        exit(EXIT_FAILURE);
+    }
+    if (from_position) {
+        // The display only understands moves, from the start of a game
+        if (!no_display) {
+            fprintf(stderr, "The display cannot start from a position; use -d\n");
+            exit(EXIT_FAILURE);
+        }
+        first_move = move_number(start_board) - (player_to_move(start_board) == O);
+    }
+
     // Set up signal handlers
     struct sigaction sa;
     sa.sa_flags = 0;
@@ -157,14 +548,35 @@ int ccheck(int argc, char *argv[])
         exit(EXIT_FAILURE);
     }
 
+    // Outside of interactive reads the signals are blocked and taken from a
+    // signalfd by the event loop; the children get the original mask back
+    sigset_t signals, old_mask;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGHUP);
+    sigaddset(&signals, SIGPIPE);
+    sigaddset(&signals, SIGCHLD);
+    sigaddset(&signals, SIGTERM);
+    if (sigprocmask(SIG_BLOCK, &signals, &old_mask) == -1) {
+        perror("sigprocmask");
+        exit(EXIT_FAILURE);
+    }
+
     // Create the board
-    Board *board = newbd();
+    Game g = {
+        .board = start_board,
+        .engine_player = engine_player,
+        .tournament_mode = tournament_mode,
+        .no_display = no_display,
+        .engine_thread = engine_thread,
+        .display = { .in = -1, .out = -1 },
+        .engine = { .in = -1, .out = -1 },
+    };
+    Board *board = g.board;
 
     // Set up pipes for display process
     int display_to_main[2];
     int main_to_display[2];
-    FILE *display_in = NULL;
-    FILE *display_out = NULL;
 
     // Start display process if not disabled
     if (!no_display) {
@@ -183,6 +595,7 @@ int ccheck(int argc, char *argv[])
             // Child process - run xdisp
             close(display_to_main[0]);  // Close read end in child
             close(main_to_display[1]);  // Close write end in child
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
 
             // Redirect stdin/stdout
             if (dup2(main_to_display[0], STDIN_FILENO) == -1) {
@@ -207,19 +620,10 @@ int ccheck(int argc, char *argv[])
         close(display_to_main[1]);  // Close write end in parent
         close(main_to_display[0]);  // Close read end in parent
 
-        display_in = fdopen(display_to_main[0], "r");
-        display_out = fdopen(main_to_display[1], "w");
-
-        if (!display_in || !display_out) {
-            perror("fdopen display");
-            cleanup_processes();
-            exit(EXIT_FAILURE);
-        }
-
-        // Wait for display to be ready
-        char ready_line[256];
-        if (fgets(ready_line, sizeof(ready_line), display_in) == NULL) {
-            fprintf(stderr, "Display process failed to initialize\n");
+        // The display's "ready" line is waited for by the event loop, with
+        // everything sent to it in the meantime queued behind it
+        if (peer_start(&g.display, "Display", display_pid, display_to_main[0], main_to_display[1]) == -1) {
+            perror("display pipe");
             cleanup_processes();
             exit(EXIT_FAILURE);
         }
@@ -234,48 +638,67 @@ int ccheck(int argc, char *argv[])
             exit(EXIT_FAILURE);
         }
     }
+    g.transcript = transcript;
+    if (transcript && from_position) {
+        // Read back by -i
+        fprintf(transcript, "position ");
+        position_print(&start, transcript);
+        fprintf(transcript, "\n");
+    }
 
-    // Read initial game history if specified
-    if (init_file) {
-        FILE *init = fopen(init_file, "r");
-        if (!init) {
-            perror("fopen init file");
+    // Open binary game log if specified, and start this game in it
+    if (log_file) {
+        g.log = gamelog_open(log_file);
+        if (!g.log || gamelog_begin(g.log, engine_player == NO_PLAYER ? -1 : (int)engine_player,
+                                    from_position ? &start : NULL) == -1) {
+            fprintf(stderr, "Could not open game log %s\n", log_file);
+            if (g.log) gamelog_close(g.log);
             cleanup_processes();
             if (transcript) fclose(transcript);
             exit(EXIT_FAILURE);
         }
+    }
 
-        Move m;
-        while ((m = read_move_from_pipe(init, board)) != 0) {
+    // Read initial game history if specified.  The whole history is applied
+    // before anything else is done: each move is checked by looking at just
+    // the piece that moves, the transcript is written through its buffer and
+    // flushed once, and the display's updates are queued for the event loop
+    // to send while the engine is already thinking.  (The
+    // display only understands moves, so it cannot be sent the final
+    // position in one message.)
+    bb_from_board(board, &g.bb);
+    if (init) {
+        char token[128];
+        while (fscanf(init, "%127s", token) == 1) {
+            // Skip the move numbers ("12." or "12. ...") in front of the moves
+            if (strchr(token, ':') == NULL) {
+                continue;
+            }
+            Move m = bb_parse_move(&g.bb, token);
+            if (m == 0 || !bb_legal(&g.bb, m)) {
+                fprintf(stderr, "Illegal move in %s: %s\n", init_file, token);
+                cleanup_processes();
+                if (transcript) fclose(transcript);
+                exit(EXIT_FAILURE);
+            }
             Player current_player = player_to_move(board);
             apply(board, m);
-            
-            // Log to transcript if specified (same logic as main game loop)
+            bb_apply(&g.bb, m);
+
+            // Log to transcript if specified, as the move was written
             if (transcript) {
-                int move_num = move_number(board);
-                if (current_player == X) {
-                    // White move: move_num will be odd (1,3,5...), display as (1,2,3...)
-                    fprintf(transcript, "%d. ", (move_num / 2) + 1);
-                } else {
-                    // Black move: move_num will be even (2,4,6...), display as (1,2,3...)
-                    fprintf(transcript, "%d. ... ", move_num / 2);
-                }
-                print_move(board, m, transcript);
-                fprintf(transcript, "\n");
-                fflush(transcript);
+                log_move(transcript, board, current_player, token);
+            }
+            if (g.log) {
+                LogRecord rec = { .move = m, .flags = LOG_HISTORY };
+                write_log(&g, &rec);
             }
 
             // Update display if active
-            if (!no_display && display_out) {
-                fprintf(display_out, ">");
-                print_move(board, m, display_out);
-                fprintf(display_out, "\n");
-                fflush(display_out);
-                kill(display_pid, SIGHUP);
-
-                // Wait for acknowledgement
-                char ack[256];
-                if (fgets(ack, sizeof(ack), display_in) == NULL) {
+            if (g.display.in != -1) {
+                char cmd[PEER_BUFSIZE + 1];
+                snprintf(cmd, sizeof(cmd), ">%s\n", token);
+                if (peer_send(&g.display, cmd) == -1) {
                     fprintf(stderr, "Display died during init\n");
                     cleanup_processes();
                     if (transcript) fclose(transcript);
@@ -284,16 +707,31 @@ int ccheck(int argc, char *argv[])
             }
         }
         fclose(init);
+        if (transcript) fflush(transcript);
     }
 
     // Set up pipes for engine process
     int engine_to_main[2];
     int main_to_engine[2];
-    FILE *engine_in = NULL;
-    FILE *engine_out = NULL;
 
-    // Start engine process if needed
-    if (engine_player != NO_PLAYER) {
+    // Or an eventfd through which an engine thread announces its replies
+    int engine_event = -1;
+
+    // Start engine thread or process if needed
+    if (engine_player != NO_PLAYER && engine_thread) {
+        channel_init(&g.commands);
+        channel_init(&g.replies);
+        engine_event = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (engine_event != -1) {
+            channel_notify(&g.replies, engine_event);
+        }
+        if (engine_event == -1 || engine_start_thread(board, &g.commands, &g.replies, &g.engine_tid) == -1) {
+            fprintf(stderr, "Engine thread failed to start\n");
+            cleanup_processes();
+            if (transcript) fclose(transcript);
+            exit(EXIT_FAILURE);
+        }
+    } else if (engine_player != NO_PLAYER) {
         if (pipe(engine_to_main) == -1 || pipe(main_to_engine) == -1) {
             perror("pipe");
             cleanup_processes();
@@ -313,6 +751,7 @@ int ccheck(int argc, char *argv[])
             // Child process - run engine
             close(engine_to_main[0]);  // Close read end in child
             close(main_to_engine[1]);  // Close write end in child
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
 
             // Redirect stdin/stdout
             if (dup2(main_to_engine[0], STDIN_FILENO) == -1) {
@@ -336,195 +775,112 @@ int ccheck(int argc, char *argv[])
         close(engine_to_main[1]);  // Close write end in parent
         close(main_to_engine[0]);  // Close read end in parent
 
-        engine_in = fdopen(engine_to_main[0], "r");
-        engine_out = fdopen(main_to_engine[1], "w");
-
-        if (!engine_in || !engine_out) {
-            perror("fdopen engine");
-            cleanup_processes();
-            if (transcript) fclose(transcript);
-            exit(EXIT_FAILURE);
-        }
-
-        // Wait for engine to be ready
-        char ready_line[256];
-        if (fgets(ready_line, sizeof(ready_line), engine_in) == NULL) {
+        // Unlike the display's, the engine's "ready" line is waited for
+        // here, since it says whether the engine takes frames
+        char hello[PEER_BUFSIZE + 1];
+        int cmd;
+        if (peer_start(&g.engine, "Engine", engine_pid, engine_to_main[0], main_to_engine[1]) == -1
+            || peer_wait(&g.engine, hello, &cmd) == -1) {
             fprintf(stderr, "Engine process failed to initialize\n");
             cleanup_processes();
             if (transcript) fclose(transcript);
             exit(EXIT_FAILURE);
         }
+        if (strcmp(hello, FRAME_HELLO) == 0) {
+            g.engine.framed = FRAME_SIZE;
+        }
+    }
+
+    // Set up the event loop: signals, replies from the children, and replies
+    // from the engine thread all arrive through one epoll instance
+    int signal_fd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+    int epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd == -1 || epfd == -1 || watch(epfd, signal_fd, EV_SIGNAL) == -1
+        || (g.display.in != -1 && watch(epfd, g.display.in, EV_DISPLAY) == -1)
+        || (g.engine.in != -1 && watch(epfd, g.engine.in, EV_ENGINE) == -1)
+        || (engine_event != -1 && watch(epfd, engine_event, EV_THREAD) == -1)) {
+        perror("event loop");
+        g.done = g.error = 1;
     }
 
     // Main game loop
-    int game_over_flag = 0;
-    int error_occurred = 0;
-    while (!game_over_flag) {
-        // Check for termination signals
-        if (sigint_received || sigpipe_received || sigterm_received) {
-            if (sigpipe_received || sigterm_received) {
-                error_occurred = 1;
+    if (!g.done) {
+        request_move(&g);
+    }
+    while (!g.done) {
+        // Wait for something to happen, or if a move is to be read from the
+        // terminal, just deal with whatever already has
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(epfd, events, MAX_EVENTS, g.from_stdin ? 0 : -1);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
             }
+            perror("epoll_wait");
+            g.error = 1;
             break;
         }
 
-        if (sigchld_received) {
-            sigchld_received = 0;
-            int status;
-            pid_t pid = waitpid(-1, &status, WNOHANG);
-            if (pid == display_pid || pid == engine_pid) {
-                fprintf(stderr, "Child process died unexpectedly\n");
-                error_occurred = 1;
-                break;
+        for (int i = 0; i < n && !g.done; i++) {
+            switch (events[i].data.u32) {
+                case EV_SIGNAL: {
+                    struct signalfd_siginfo si;
+                    while (!g.done && read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+                        handle_signal(&g, si.ssi_signo);
+                    }
+                    break;
+                }
+                case EV_DISPLAY:
+                    peer_input(&g, &g.display);
+                    break;
+                case EV_ENGINE:
+                    peer_input(&g, &g.engine);
+                    break;
+                case EV_THREAD:
+                    thread_input(&g, engine_event);
+                    break;
             }
         }
 
-        Player current_player = player_to_move(board);
-        Move move = 0;
-
-        // Determine how to get the move
-        if (current_player == engine_player && engine_in && engine_out) {
-            // Engine's turn - request move
-            fprintf(engine_out, "<\n");
-            fflush(engine_out);
-            kill(engine_pid, SIGHUP);
-
-            // Read move from engine
-            move = read_move_from_pipe(engine_in, board);
-            if (move == 0) {
-                fprintf(stderr, "Engine died\n");
-                error_occurred = 1;
-                break;
-            }
-
-            // Charge engine for time
-            setclock(current_player);
-
-        } else if (!no_display && !tournament_mode && display_in && display_out) {
-            // Interactive mode with display - request move from display
-            fprintf(display_out, "<\n");
-            fflush(display_out);
-            kill(display_pid, SIGHUP);
-
-            // Read move from display
-            move = read_move_from_pipe(display_in, board);
-            if (move == 0) {
-                fprintf(stderr, "Display died\n");
-                error_occurred = 1;
-                break;
-            }
-
-            // Charge player for time
-            setclock(current_player);
-
-        } else {
-            // Interactive mode from stdin
-            move = read_move_interactive(board);
+        if (n == 0 && g.from_stdin) {
+            // Interactive mode from stdin, with the signals unblocked so
+            // that they interrupt the read as they always have
+            g.from_stdin = 0;
+            sigprocmask(SIG_SETMASK, &old_mask, NULL);
+            Move move = read_move_interactive(board);
+            sigprocmask(SIG_BLOCK, &signals, NULL);
+            handle_caught_signals(&g);
             if (move == 0) {
                 // EOF
                 break;
             }
-
-            // Charge player for time
-            setclock(current_player);
-        }
-
-        // Apply the move
-        apply(board, move);
-
-        // Print move - in tournament mode, prefix computer moves with @@@
-        if (tournament_mode && current_player == engine_player) {
-            printf("@@@");
-        }
-        print_move(board, move, stdout);
-        printf("\n");
-        fflush(stdout);
-
-        // Update display if active
-        if (!no_display && display_out) {
-            fprintf(display_out, ">");
-            print_move(board, move, display_out);
-            fprintf(display_out, "\n");
-            fflush(display_out);
-            kill(display_pid, SIGHUP);
-
-            // Wait for acknowledgement
-            char ack[256];
-            if (fgets(ack, sizeof(ack), display_in) == NULL) {
-                fprintf(stderr, "Display died\n");
-                error_occurred = 1;
-                break;
-            }
-        }
-
-        // Print board if no display
-        if (no_display) {
-            print_bd(board, stdout);
-        }
-
-        // Log to transcript  (note: this is AFTER apply(), so move_num has been incremented)
-        if (transcript) {
-            int move_num = move_number(board);
-            if (current_player == X) {
-                // White move: move_num will be odd (1,3,5...), display as (1,2,3...)
-                fprintf(transcript, "%d. ", (move_num / 2) + 1);
-            } else {
-                // Black move: move_num will be even (2,4,6...), display as (1,2,3...)
-                fprintf(transcript, "%d. ... ", move_num / 2);
-            }
-            print_move(board, move, transcript);
-            fprintf(transcript, "\n");
-            fflush(transcript);
-        }
-
-        // Send move to engine if it's the opponent's move
-        if (current_player != engine_player && engine_player != NO_PLAYER && engine_out) {
-            fprintf(engine_out, ">");
-            print_move(board, move, engine_out);
-            fprintf(engine_out, "\n");
-            fflush(engine_out);
-            kill(engine_pid, SIGHUP);
-            
-            // Wait for acknowledgement
-            char ack[256];
-            if (fgets(ack, sizeof(ack), engine_in) == NULL) {
-                fprintf(stderr, "Engine died\n");
-                error_occurred = 1;
-                break;
+            if (!g.done) {
+                play_move(&g, move, NULL);
             }
         }
-
-        // Check if game is over
-        int winner = game_over(board);
-        if (winner != 0) {
-            if (winner == 1) {
-                printf("White wins!\n");
-            } else {
-                printf("Black wins!\n");
-            }
-            game_over_flag = 1;
-
-            // Wait for termination signal
-            while (!sigint_received && !sigchld_received && !sigterm_received) {
-                pause();
-            }
-            break;
-        }
     }
 
     // Cleanup
+    if (engine_player != NO_PLAYER && engine_thread) {
+        channel_send(&g.commands, (Message){ MSG_QUIT, 0 });
+        pthread_join(g.engine_tid, NULL);
+    }
     cleanup_processes();
-    if (display_in) fclose(display_in);
-    if (display_out) fclose(display_out);
-    if (engine_in) fclose(engine_in);
-    if (engine_out) fclose(engine_out);
+    peer_close(&g.display);
+    peer_close(&g.engine);
+    if (engine_event != -1) close(engine_event);
+    if (signal_fd != -1) close(signal_fd);
+    if (epfd != -1) close(epfd);
     if (transcript) fclose(transcript);
-    
+    if (g.log && gamelog_close(g.log) == -1) {
+        perror("game log");
+    }
+
     // Free board memory
     free(board);
 
     // Wait for any remaining children
     while (waitpid(-1, NULL, WNOHANG) > 0);
 
-    return error_occurred ? EXIT_FAILURE : EXIT_SUCCESS;
+    return g.error ? EXIT_FAILURE : EXIT_SUCCESS;
 }
@@ -0,0 +1,89 @@
+/*
+ * Lock-free single-producer, single-consumer message queue
+ */
+
+#include <limits.h>
+#include <stdint.h>
+#include <sched.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+
+#include "ccheck.h"
+#include "channel.h"
+#include "debug.h"
+
+static void futex_wait(unsigned *addr, unsigned val) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, val, NULL, NULL, 0);
+}
+
+static void futex_wake(unsigned *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+}
+
+void channel_init(Channel *ch)
+{
+    ch->head = ch->tail = 0;
+    ch->sleeping = 0;
+    ch->notify = -1;
+}
+
+void channel_notify(Channel *ch, int fd)
+{
+    ch->notify = fd;
+}
+
+void channel_send(Channel *ch, Message msg)
+{
+    unsigned tail = __atomic_load_n(&ch->tail, __ATOMIC_RELAXED);
+    // The protocol never has more than a couple of messages outstanding,
+    // so a full ring is not worth sleeping over
+    while (tail - __atomic_load_n(&ch->head, __ATOMIC_ACQUIRE) == CHANNEL_SIZE) {
+        sched_yield();
+    }
+    ch->ring[tail % CHANNEL_SIZE] = msg;
+    // Publishing the slot and then checking for a sleeper, both sequentially
+    // consistent, pairs with the receiver announcing that it sleeps and then
+    // checking for a slot: one of the two always sees the other
+    __atomic_store_n(&ch->tail, tail + 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&ch->sleeping, __ATOMIC_SEQ_CST)) {
+        futex_wake(&ch->tail);
+    }
+    if (ch->notify != -1) {
+        uint64_t one = 1;
+        if (write(ch->notify, &one, sizeof(one)) == -1) {
+            debug("eventfd write failed");
+        }
+    }
+}
+
+int channel_pending(Channel *ch)
+{
+    return __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE) != __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+}
+
+void channel_wait(Channel *ch)
+{
+    unsigned head = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+    while (1) {
+        unsigned tail = __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE);
+        if (tail != head) {
+            return;
+        }
+        __atomic_store_n(&ch->sleeping, 1, __ATOMIC_SEQ_CST);
+        // The futex call itself returns at once if tail has moved on
+        if (__atomic_load_n(&ch->tail, __ATOMIC_SEQ_CST) == head) {
+            futex_wait(&ch->tail, head);
+        }
+        __atomic_store_n(&ch->sleeping, 0, __ATOMIC_RELAXED);
+    }
+}
+
+Message channel_receive(Channel *ch)
+{
+    channel_wait(ch);
+    unsigned head = __atomic_load_n(&ch->head, __ATOMIC_RELAXED);
+    Message msg = ch->ring[head % CHANNEL_SIZE];
+    __atomic_store_n(&ch->head, head + 1, __ATOMIC_RELEASE);
+    return msg;
+}
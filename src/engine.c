@@ -4,247 +4,743 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 #include <signal.h>
-#include <setjmp.h>
 #include <time.h>
-#include <sys/time.h>
+#include <pthread.h>
 
 #include "ccheck.h"
+#include "engine.h"
+#include "channel.h"
+#include "frame.h"
+#include "bitboard.h"
+#include "search.h"
+#include "race.h"
+#include "book.h"
+#include "timectl.h"
+#include "telemetry.h"
+#include "nnue.h"
 #include "debug.h"
 
-static volatile sig_atomic_t sighup_received = 0;
-static volatile sig_atomic_t time_to_move = 0;
-static volatile sig_atomic_t in_search = 0;
-static sigjmp_buf env;
+#define ASPIRATION_WINDOW 250             // Half-width of the first aspiration window
+#define PONDER_REPLIES 6                  // Opponent replies searched while pondering
+#define PONDER_RANK_DEPTH 3               // Depth of the search that ranks them
+#define RACE_NODES 100000                 // Positions the race solver may examine per side
+
+int ponder_enabled = 1;
 
-// Signal handler for SIGHUP
+static volatile sig_atomic_t sighup_received = 0;
+static Channel *inbox, *outbox;           // Where commands and replies go, when running as a thread
+static int framed;                        // Commands arrive as frames, so replies go as frames
+static Bitboard pos;                      // The engine's board as a Bitboard, kept in step with it
+static MoveSet legal;                     // Legal moves, for checking moves that arrive in frames
+static long move_nodes;                   // Positions searched since the position arose
+static Iteration record;                  // The iteration being searched, for telemetry
+
+// Search results for the position after one of the opponent's replies
+typedef struct ponder_slot {
+    Move reply;                           // The opponent's move
+    int depth_completed;                  // Depth of the last completed search after it
+    int last_score;                       // Its score, for the player to move after it
+    int done;                             // Nothing more to search
+    Move pv[MAXDEPTH + 1];                // Its principal variation
+} PonderSlot;
+
+static PonderSlot slots[PONDER_REPLIES];  // Replies being pondered, likeliest first
+static int nslots;                        // 0 until the replies have been ranked
+static long ponder_hits, ponder_misses;
+
+// Signal handler for SIGHUP: a command is waiting, so any search in
+// progress should wind up and return
 static void sighup_handler(int sig) {
     sighup_received = 1;
-    time_to_move = 1;
-    if (in_search) {
-        siglongjmp(env, 1);
+    stop_search = 1;
+}
+
+// Whether a command is waiting, so that any search in progress should wind up
+static int command_pending(void) {
+    return inbox != NULL ? channel_pending(inbox) : sighup_received;
+}
+
+// Read the next command from stdin, in the form in which commands arrive
+// on a channel.  A command is either a text line or a frame.
+static Message read_command(Board *board) {
+    Message msg = { MSG_QUIT, 0 };
+    int c = getchar();
+    if (c == EOF) {
+        return msg;
+    }
+    if (c == MSG_REQUEST || c == MSG_OPPONENT || c == MSG_QUIT) {
+        Frame f;
+        f.type = c;
+        if (fread((char *)&f + 1, FRAME_SIZE - 1, 1, stdin) != 1) {
+            return msg;
+        }
+        framed = 1;
+        msg.type = f.type;
+        msg.move = f.move;
+        if (msg.type == MSG_OPPONENT) {
+            if (!moveset_legal(&legal, &pos, msg.move)) {
+                fprintf(stderr, "Engine received an illegal move\n");
+                _exit(EXIT_FAILURE);
+            }
+        }
+        return msg;
     }
+    ungetc(c, stdin);
+
+    char line[256];
+    if (fgets(line, sizeof(line), stdin) == NULL) {
+        return msg;
+    }
+    if (line[0] == '<') {
+        msg.type = MSG_REQUEST;
+    } else if (line[0] == '>') {
+        // The opponent's move follows the '>' on the line just read
+        FILE *in = fmemopen(line + 1, strlen(line + 1), "r");
+        if (in == NULL) {
+            _exit(EXIT_FAILURE);
+        }
+        msg.move = read_move_from_pipe(in, board);
+        fclose(in);
+        msg.type = msg.move != 0 ? MSG_OPPONENT : MSG_QUIT;
+    } else {
+        msg.type = 0;
+    }
+    return msg;
 }
 
-// Signal handler for SIGALRM
-static void sigalrm_handler(int sig) {
-    time_to_move = 1;
-    if (in_search) {
-        siglongjmp(env, 1);
+// Send a reply (MSG_MOVE or MSG_OK) to whoever sent the command
+static void reply(Board *board, Message msg) {
+    if (outbox != NULL) {
+        channel_send(outbox, msg);
+    } else if (framed) {
+        Frame f;
+        frame_make(&f, msg.type, &pos, msg.move);
+        f.depth = msg.depth;
+        f.score = msg.score;
+        f.nodes = msg.nodes;
+        fwrite(&f, FRAME_SIZE, 1, stdout);
+        fflush(stdout);
+    } else if (msg.type == MSG_MOVE) {
+        print_move(board, msg.move, stdout);
+        printf("\n");
+        fflush(stdout);
+    } else {
+        printf("OK\n");
+        fflush(stdout);
     }
 }
 
-void engine(Board *bp)
+// Search a position to the depth given by "depth", starting from the principal
+// variation and score of the last completed depth, if any.  The outcome is left
+// in search_status, as by search; if the search completes, its time and
+// node count are recorded for time control and (in verbose mode) the results
+// are printed.
+static int iterate(Board *board, Move *pv, int depth_completed, int last_score) {
+    if (verbose) {
+        fprintf(stderr, "Searching depth %d...", depth);
+        fflush(stderr);
+    }
+
+    reset_stats();
+    long start = clock_ms();
+    long nodes = 0;
+    long start_us = telemetry_fd != -1 ? clock_us() : 0;
+
+    // With PVS, expect the score to be close to the last depth's and
+    // search a narrow window around it, widening it on the side where
+    // the score falls outside until it lands inside
+    int alpha = -MAXEVAL, beta = MAXEVAL;
+    int window = ASPIRATION_WINDOW;
+    if (search_algorithm == SEARCH_PVS && depth_completed > 0) {
+        alpha = last_score - window;
+        beta = last_score + window;
+    }
+    int score;
+    while (1) {
+        score = search(board, player_to_move(board), pv, alpha, beta);
+        nodes += search_nodes;
+        move_nodes += search_nodes;
+        if (telemetry_fd != -1) {
+            long cutoffs, first;
+            search_cutoffs(&cutoffs, &first);
+            record.stepgens += bb_stats.stepgens;
+            record.steptot += bb_stats.steptot;
+            record.jumpgens += bb_stats.jumpgens;
+            record.jumptot += bb_stats.jumptot;
+            record.cutoffs += cutoffs;
+            record.firstcutoffs += first;
+        }
+        if (search_status != SEARCH_COMPLETE || (score > alpha && score < beta)) {
+            break;
+        }
+        record.researches++;
+        window *= 4;
+        if (score <= alpha) {
+            alpha = score - window > -MAXEVAL ? score - window : -MAXEVAL;
+        } else {
+            beta = score + window < MAXEVAL ? score + window : MAXEVAL;
+        }
+        if (verbose) {
+            fprintf(stderr, " re-searching [%d, %d]...", alpha, beta);
+            fflush(stderr);
+        }
+    }
+    search_set_deadline(0);
+    if (telemetry_fd != -1) {
+        record.depth = depth;
+        record.status = search_status;
+        record.score = score;
+        record.nodes = nodes;
+        record.us = clock_us() - start_us;
+        telemetry_iteration(board, &record, pv);
+    }
+
+    if (search_status != SEARCH_COMPLETE) {
+        // Stopped by a command or the deadline.  A partial result still
+        // searched the last completed depth's best move to the new depth,
+        // so the best root move it found is at least as good; keep it.
+        if (verbose) {
+            if (search_status == SEARCH_PARTIAL) {
+                fprintf(stderr, " interrupted, best so far ");
+                print_move(board, pv[0], stderr);
+                fprintf(stderr, " (%d)\n", score);
+            } else {
+                fprintf(stderr, " interrupted\n");
+            }
+        }
+        return score;
+    }
+
+    // Update timing estimates (the library's are kept for print_stats)
+    tc_record(depth, nodes, clock_ms() - start);
+    if (depth <= MAXPLY) {
+        timings(depth);
+    }
+
+    // Print search information if verbose
+    if (verbose) {
+        print_stats();
+        tt_print_stats();
+        search_print_stats();
+        search_print_pvar(board, pv, depth);
+        fprintf(stderr, "\n");
+    }
+    return score;
+}
+
+// Think on the opponent's time.  Rather than following only the reply the
+// principal variation predicts, the likeliest few replies are each given a
+// search of their own, deepened in turn with more of the time going to the
+// more plausible ones, so that the results for whichever reply is played can
+// be picked up where they were left.  Runs until a command arrives.
+static void ponder(Board *board, Board *after, Move *pv, int depth_completed, int last_score) {
+    if (nslots == 0) {
+        Move replies[PONDER_REPLIES];
+        int scores[PONDER_REPLIES];
+        if (verbose) {
+            fprintf(stderr, "Ranking replies...");
+            fflush(stderr);
+        }
+        int n = search_replies(board, PONDER_RANK_DEPTH, replies, scores, PONDER_REPLIES);
+        if (n == 0) {
+            if (verbose) {
+                fprintf(stderr, " interrupted\n");
+            }
+            return;
+        }
+        for (int i = 0; i < n; i++) {
+            PonderSlot *slot = &slots[i];
+            slot->reply = replies[i];
+            slot->depth_completed = 0;
+            slot->last_score = 0;
+            slot->done = 0;
+            // The predicted reply carries on from the principal variation
+            if (replies[i] == pv[0] && depth_completed > 1) {
+                memcpy(slot->pv, pv + 1, (depth_completed - 1) * sizeof(Move));
+                slot->depth_completed = depth_completed - 1;
+                slot->last_score = -last_score;
+            }
+            if (verbose) {
+                fprintf(stderr, " ");
+                print_move(board, replies[i], stderr);
+                fprintf(stderr, " (%d)", scores[i]);
+            }
+        }
+        if (verbose) {
+            fprintf(stderr, "\n");
+        }
+        nslots = n;
+    }
+
+    while (!command_pending()) {
+        // Deepen the reply that is furthest behind, counting the less
+        // plausible ones as further ahead than they are
+        PonderSlot *slot = NULL;
+        int behind = 0;
+        for (int i = 0; i < nslots; i++) {
+            int d = slots[i].depth_completed + (i == 0 ? 0 : i < 3 ? 1 : 2);
+            if (!slots[i].done && (slot == NULL || d < behind)) {
+                slot = &slots[i];
+                behind = d;
+            }
+        }
+        if (slot == NULL) {
+            // Every reply has been searched as far as it can go
+            return;
+        }
+
+        copybd(board, after);
+        apply(after, slot->reply);
+        depth = slot->depth_completed + 1;
+        if (verbose) {
+            fprintf(stderr, "After ");
+            print_move(board, slot->reply, stderr);
+            fprintf(stderr, ": ");
+        }
+        record = (Iteration){ .budget = BUDGET_PONDER };
+        int score = iterate(after, slot->pv, slot->depth_completed, slot->last_score);
+        if (search_status != SEARCH_COMPLETE) {
+            return;
+        }
+        slot->depth_completed = depth;
+        slot->last_score = score;
+        if (depth >= max_depth || score == -WINEVAL || score == WINEVAL) {
+            slot->done = 1;
+        }
+    }
+}
+
+// Whether the two sides have passed each other, so that solve_race applies
+static int in_race(const Bitboard *bp) {
+    return race_detect(bp);
+}
+
+// The book move for a position, if it is in the opening book
+static int book_move(const Bitboard *bp, Move *m) {
+    if (!book_probe(bp, m)) {
+        return 0;
+    }
+    if (verbose) {
+        fprintf(stderr, "Book move\n");
+    }
+    return 1;
+}
+
+// Once the sides have passed each other, work out the race exactly instead of
+// searching: the shortest race home is the best move.  Each solve gives up
+// after "ms" milliseconds (0 for no limit).  Returns 1 if solved, with the
+// first move of a shortest race in pv[0].
+static int solve_race(const Bitboard *bp, Move *pv, long ms) {
+    Move best, theirs_best;
+    if (!race_detect(bp)) {
+        return 0;
+    }
+    long start = clock_ms();
+    int ours = race_moves(bp, bp->tomove, &best, RACE_NODES, ms);
+    if (ours <= 0) {
+        if (verbose) {
+            fprintf(stderr, "Race too long to solve, searching instead\n");
+        }
+        return 0;
+    }
+    pv[0] = best;
+
+    // The opponent's race only tells who wins, which is just for show, and
+    // gets whatever is left of the time
+    if (verbose) {
+        long left = ms > 0 ? ms - (clock_ms() - start) : 0;
+        int theirs = ms > 0 && left <= 0 ? -1
+                     : race_moves(bp, 1 - bp->tomove, &theirs_best, RACE_NODES, left);
+        if (theirs < 0) {
+            fprintf(stderr, "Race: %d moves (proven)\n", ours);
+        } else {
+            fprintf(stderr, "Race: %d moves against %d, %s (proven)\n", ours, theirs,
+                    ours <= theirs ? "won" : "lost");
+        }
+    }
+    return 1;
+}
+
+int engine_option(int option, char *arg)
 {
-    // Set up signal handlers
-    struct sigaction sa;
-    sa.sa_flags = 0;
-    sigemptyset(&sa.sa_mask);
+    switch (option) {
+        case 'r':
+            randomized = 1;
+            break;
+        case 'a':
+        {
+            // Time control works in milliseconds; the library's avgtime
+            // keeps whole seconds
+            char *end;
+            double secs = strtod(arg, &end);
+            if (*arg == '\0' || *end != '\0' || secs < 0) {
+                fprintf(stderr, "Average time must be a number of seconds.\n");
+                return -1;
+            }
+            avgtime_ms = (long)(secs * 1000 + 0.5);
+            avgtime = avgtime_ms / 1000;
+            break;
+        }
+        case 'H':
+            hash_mb = atoi(arg);
+            if (hash_mb < 1) {
+                fprintf(stderr, "Hash table size must be at least 1 megabyte.\n");
+                return -1;
+            }
+            break;
+        case 'R':
+            if (strcmp(arg, "depth") == 0) {
+                hash_policy = TT_REPLACE_DEPTH;
+            } else if (strcmp(arg, "always") == 0) {
+                hash_policy = TT_REPLACE_ALWAYS;
+            } else {
+                fprintf(stderr, "Unknown replacement policy: %s.\n", arg);
+                return -1;
+            }
+            break;
+        case 'T':
+            search_threads = atoi(arg);
+            if (search_threads < 1 || search_threads > MAXTHREADS) {
+                fprintf(stderr, "Number of threads must be between 1 and %d.\n", MAXTHREADS);
+                return -1;
+            }
+            break;
+        case 'D':
+            max_depth = atoi(arg);
+            if (max_depth < 1 || max_depth > MAXDEPTH) {
+                fprintf(stderr, "Search depth must be between 1 and %d.\n", MAXDEPTH);
+                return -1;
+            }
+            break;
+        case 'S':
+            if (strcmp(arg, "alphabeta") == 0) {
+                search_algorithm = SEARCH_ALPHABETA;
+            } else if (strcmp(arg, "pvs") == 0) {
+                search_algorithm = SEARCH_PVS;
+            } else {
+                fprintf(stderr, "Unknown search algorithm: %s.\n", arg);
+                return -1;
+            }
+            break;
+        case 'B':
+            book_file = arg;
+            break;
+        case 'P':
+            ponder_enabled = 0;
+            break;
+        case 'M':
+            if (telemetry_open(arg) == -1) {
+                perror(arg);
+                return -1;
+            }
+            break;
+        case 'N':
+            if (nnue_load(arg) == -1) {
+                fprintf(stderr, "Could not load network file %s.\n", arg);
+                return -1;
+            }
+            break;
+        default:
+            fprintf(stderr, "Unknown option: -%c.\n", option);
+            return -1;
+    }
+    return 0;
+}
 
-    sa.sa_handler = sighup_handler;
-    if (sigaction(SIGHUP, &sa, NULL) == -1) {
-        perror("sigaction SIGHUP");
+// The engine proper: think, and answer commands as they come, until the
+// input ends.  Commands come on stdin, each announced by SIGHUP, unless the
+// engine runs as a thread, in which case they come on inbox.
+static void run(Board *bp)
+{
+    // The transposition table lives as long as the engine, so that what was
+    // learned while pondering and on earlier moves is reused
+    if (tt_init() == -1) {
+        fprintf(stderr, "Engine could not allocate transposition table\n");
         _exit(EXIT_FAILURE);
     }
 
-    sa.sa_handler = sigalrm_handler;
-    if (sigaction(SIGALRM, &sa, NULL) == -1) {
-        perror("sigaction SIGALRM");
-        _exit(EXIT_FAILURE);
+    // The book is mapped, not read, so engines using the same one share it
+    if (book_file != NULL && book_open(book_file) == -1) {
+        fprintf(stderr, "Engine could not open book %s, playing without it\n", book_file);
     }
 
     Board *board = newbd();
     copybd(bp, board);
+    Board *after = newbd();               // Scratch board for pondering
+
+    // Frames are made and checked from the Bitboard, which is updated move
+    // by move instead of being rebuilt from the board each time
+    if (bb_from_board(board, &pos) == -1) {
+        fprintf(stderr, "Engine could not read its board\n");
+        _exit(EXIT_FAILURE);
+    }
 
     int our_turn = 0;
+    int pondering = 0;                    // The opponent is to move after our move
+    int probed = 0;                       // The book and race solver have been tried here
+    int solved = 0;                       // One of them gave the move in pv[0]
     int depth_completed = 0;
-
-    // Announce that we're ready
-    printf("Engine ready\n");
-    fflush(stdout);
+    int last_score = 0;                   // Score of the last completed depth, if any
+    // Principal variation; unlike principal_var, it has room for max_depth moves
+    Move pv[MAXDEPTH + 1] = { 0 };
+
+    // Announce that we're ready, and can take frames (a thread's commands
+    // just wait in the channel)
+    if (inbox == NULL) {
+        printf(FRAME_HELLO);
+        fflush(stdout);
+    }
 
     while (1) {
         // Check if we've been signaled before starting/continuing search
-        if (sighup_received) {
-            sighup_received = 0;
+        if (command_pending()) {
             goto process_command;
         }
 
-        // Search loop - iteratively deepen search
-        for (depth = depth_completed + 1; depth <= MAXPLY; depth++) {
-            time_to_move = 0;
-
-            // If it's our turn and avgtime is 0, only search to depth 1
-            if (our_turn && avgtime == 0 && depth > 1) {
-                break;
+        // In a race there is nothing to ponder, and our move is solved outright;
+        // in the book there is nothing to search, leaving the time for later moves
+        if (pondering) {
+            if (ponder_enabled && !in_race(&pos)) {
+                ponder(board, after, pv, depth_completed, last_score);
             }
+        } else if (!probed) {
+            probed = 1;
+            // On our turn the race must be solved within the move's time
+            long race_ms = our_turn && avgtime_ms > 0 ? tc_remaining() : 0;
+            if (book_move(&pos, pv) || solve_race(&pos, pv, race_ms)) {
+                depth_completed = 1;
+                solved = 1;
+            }
+        }
 
-            // If it's our turn and avgtime > 0, check time budget before searching
-            if (our_turn && avgtime > 0) {
-                // Calculate time budget for this move
-                // Total time we should have used = avgtime * moves_we_made
-                // Actual time used = xtime or otime (depending on which player we are)
-                // Time available for this move = avgtime + (budget - actual)
-                Player our_player = player_to_move(board);
-                int moves_made = move_number(board);
-                int moves_we_made = (moves_made + 1) / 2;  // Half the moves are ours
-                int total_time_used = (our_player == X) ? xtime : otime;
-                int time_budget = avgtime * moves_we_made;
-                int time_available = avgtime + (time_budget - total_time_used);
-                
-                // Make sure we have positive time available
-                if (time_available < 1) {
-                    time_available = 1;
-                }
-
-                // Check if we have time to search to this depth
-                // Don't start a search if estimated time exceeds what we have available
-                if (times[depth] > time_available) {
+        // Search loop - iteratively deepen search
+        Move best = depth_completed > 0 ? pv[0] : 0;
+        for (depth = depth_completed + 1; !pondering && !solved && depth <= max_depth; depth++) {
+            record = (Iteration){ .budget = BUDGET_NONE };
+            if (our_turn) {
+                // If avgtime is 0, only search to depth 1
+                if (avgtime_ms == 0 && depth > 1) {
                     break;
                 }
 
-                // Set alarm for time limit - give ourselves the average time per move
-                struct itimerval timer;
-                timer.it_value.tv_sec = time_available;
-                timer.it_value.tv_usec = 0;
-                timer.it_interval.tv_sec = 0;
-                timer.it_interval.tv_usec = 0;
-                setitimer(ITIMER_REAL, &timer, NULL);
+                // Don't start an iteration that is not expected to finish in
+                // the time for this move, and stop one that runs over.  Depth 1
+                // always runs to completion, so that there is a move to play.
+                if (avgtime_ms > 0 && depth_completed > 0) {
+                    int start = tc_start_iteration(depth);
+                    if (telemetry_fd != -1) {
+                        record.budget = start ? BUDGET_START : BUDGET_STOP;
+                        record.predicted_ms = tc_predict(depth);
+                        tc_budget(&record.elapsed_ms, &record.target_ms, &record.limit_ms);
+                        if (!start) {
+                            record.depth = depth;
+                            record.status = -1;
+                            telemetry_iteration(board, &record, pv);
+                        }
+                    }
+                    if (!start) {
+                        break;
+                    }
+                    search_set_deadline(tc_remaining());
+                }
             }
 
-            // Perform search at current depth
-            if (verbose) {
-                fprintf(stderr, "Searching depth %d...", depth);
-                fflush(stderr);
+            int score = iterate(board, pv, depth_completed, last_score);
+            if (search_status != SEARCH_COMPLETE) {
+                break;
             }
+            depth_completed = depth;
+            last_score = score;
 
-            reset_stats();
-
-            // Use sigsetjmp to allow escape from bestmove if interrupted
-            in_search = 1;
-            if (sigsetjmp(env, 1) == 0) {
-                int score = bestmove(board, player_to_move(board), 0, principal_var, -MAXEVAL, MAXEVAL);
-
-                in_search = 0;
-
-                // Update timing estimates
-                timings(depth);
-                depth_completed = depth;
-
-                // Print search information if verbose
-                if (verbose) {
-                    print_stats();
-                    print_pvar(board, depth);
-                    fprintf(stderr, "\n");
-                }
-
-                // Stop searching if we found a winning or losing position
-                if (score == -(MAXEVAL-1) || score == MAXEVAL-1) {
-                    break;
-                }
-            } else {
-                // Interrupted by signal - stop searching and process command
-                in_search = 0;
-                if (verbose) {
-                    fprintf(stderr, " interrupted\n");
-                }
-                break;
+            // A change of mind is a sign that the move needs more thought
+            if (our_turn && avgtime_ms > 0 && best != 0 && pv[0] != best) {
+                tc_best_changed();
             }
+            best = pv[0];
 
-            // Cancel alarm if set
-            if (our_turn && avgtime > 0) {
-                struct itimerval timer;
-                timer.it_value.tv_sec = 0;
-                timer.it_value.tv_usec = 0;
-                timer.it_interval.tv_sec = 0;
-                timer.it_interval.tv_usec = 0;
-                setitimer(ITIMER_REAL, &timer, NULL);
+            // Stop searching if we found a winning or losing position
+            if (score == -WINEVAL || score == WINEVAL) {
+                break;
             }
 
             // Check if we were interrupted and need to process a command
-            if (sighup_received) {
-                sighup_received = 0;
+            if (command_pending()) {
                 break;
             }
         }
 
-        // Wait for SIGHUP if we haven't received one yet
-        if (!sighup_received) {
-            while (!sighup_received) {
-                pause();
+        if (our_turn) {
+            // Send the best move, with what the search found (nothing, for
+            // a book or race move)
+            best = pv[0];
+            reply(board, (Message){ MSG_MOVE, best, solved ? 0 : depth_completed,
+                                    solved ? 0 : last_score, move_nodes });
+            if (verbose && avgtime_ms > 0) {
+                tc_print();
             }
-        }
-        sighup_received = 0;
-
-process_command:
-
-        // Read command from stdin
-        char line[256];
-        if (fgets(line, sizeof(line), stdin) == NULL) {
-            // EOF - exit
-            _exit(EXIT_SUCCESS);
-        }
-
-        if (line[0] == '<') {
-            // Request to generate a move
-            our_turn = 1;
+            tc_end_move();
 
-            // Make sure we have completed at least 1-ply search
-            if (depth_completed < 1) {
-                depth = 1;
-                reset_stats();
-                bestmove(board, player_to_move(board), 0, principal_var, -MAXEVAL, MAXEVAL);
-                timings(1);
-                depth_completed = 1;
+            // The protocol only carries the end points; show the hops as well
+            if (verbose) {
+                fprintf(stderr, "Playing ");
+                bb_print_move(&pos, best, stderr);
+                fprintf(stderr, "\n");
             }
 
-            // Send the best move
-            Move best = principal_var[0];
-            print_move(board, best, stdout);
-            printf("\n");
-            fflush(stdout);
-
-            // Apply the move to our board
+            // Apply the move to our board, and gather the opponent's
+            // replies now, so that checking the one made is a lookup
             apply(board, best);
+            bb_apply(&pos, best);
+            if (framed) {
+                moveset_fill(&legal, &pos);
+            }
             our_turn = 0;
+            pondering = 1;
+            nslots = 0;
+            probed = solved = 0;
 
             // Adjust depth_completed if principal variation is still valid
             if (depth_completed > 0) {
                 // Shift principal variation down
                 for (int i = 0; i < depth_completed - 1; i++) {
-                    principal_var[i] = principal_var[i + 1];
+                    pv[i] = pv[i + 1];
                 }
                 depth_completed--;
+                // The score now belongs to the opponent
+                last_score = -last_score;
             }
+            continue;
+        }
 
-        } else if (line[0] == '>') {
-            // Opponent's move received
-            Move m = read_move_from_pipe(stdin, board);
-            if (m == 0) {
-                _exit(EXIT_SUCCESS);
+        // Wait for a command if there isn't one yet
+        if (inbox != NULL) {
+            channel_wait(inbox);
+        } else {
+            while (!sighup_received) {
+                pause();
             }
+        }
+
+process_command:
+        // The command is about to be handled, so later searches may run
+        sighup_received = 0;
+        stop_search = 0;
+
+        Message msg = inbox != NULL ? channel_receive(inbox) : read_command(board);
+        if (msg.type == MSG_QUIT) {
+            free(after);
+            free(board);
+            return;
+        }
 
+        // Each move starts a new generation of hash table entries
+        tt_new_search();
+
+        if (msg.type == MSG_REQUEST) {
+            // Request to generate a move: the clock starts now, and the move
+            // is sent once the search loop has used its time
+            our_turn = 1;
+            tc_start_move();
+        } else if (msg.type == MSG_OPPONENT) {
             // Apply opponent's move
+            Move m = msg.move;
             apply(board, m);
+            bb_apply(&pos, m);
+            move_nodes = 0;
 
             // Send acknowledgement
-            printf("OK\n");
-            fflush(stdout);
+            reply(board, (Message){ MSG_OK, 0 });
 
-            // Check if this matches our predicted move
-            if (depth_completed > 0 && m == principal_var[0]) {
-                // Principal variation is still valid, shift it
+            // Pick up the search after this reply if it was pondered
+            PonderSlot *slot = NULL;
+            for (int i = 0; i < nslots; i++) {
+                if (slots[i].reply == m && slots[i].depth_completed > 0) {
+                    slot = &slots[i];
+                }
+            }
+            if (nslots > 0) {
+                if (slot != NULL) {
+                    ponder_hits++;
+                } else {
+                    ponder_misses++;
+                }
+                if (verbose) {
+                    fprintf(stderr, "Ponder %s (%ld of %ld so far)\n", slot != NULL ? "hit" : "miss",
+                            ponder_hits, ponder_hits + ponder_misses);
+                }
+            }
+            pondering = 0;
+            nslots = 0;
+            probed = solved = 0;
+
+            if (slot != NULL) {
+                memcpy(pv, slot->pv, slot->depth_completed * sizeof(Move));
+                depth_completed = slot->depth_completed;
+                last_score = slot->last_score;
+            } else if (depth_completed > 0 && m == pv[0]) {
+                // The predicted move: principal variation is still valid, shift it
                 for (int i = 0; i < depth_completed - 1; i++) {
-                    principal_var[i] = principal_var[i + 1];
+                    pv[i] = pv[i + 1];
                 }
                 depth_completed--;
+                last_score = -last_score;
             } else {
                 // Principal variation is no longer valid
                 depth_completed = 0;
             }
         }
     }
+}
+
+void engine(Board *bp)
+{
+    // Set up signal handlers
+    struct sigaction sa;
+    sa.sa_flags = 0;
+    sigemptyset(&sa.sa_mask);
+
+    sa.sa_handler = sighup_handler;
+    if (sigaction(SIGHUP, &sa, NULL) == -1) {
+        perror("sigaction SIGHUP");
+        _exit(EXIT_FAILURE);
+    }
 
+    run(bp);
     _exit(EXIT_SUCCESS);
 }
+
+static int interrupt(void) {
+    return channel_pending(inbox);
+}
+
+static void *engine_thread(void *arg) {
+    Board *bp = arg;
+    // Signals are for the game's own thread, which waits for them
+    sigset_t all;
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, NULL);
+
+    // A command waiting on the channel stops the search, as SIGHUP would
+    search_interrupt = interrupt;
+    run(bp);
+    free(bp);
+    return NULL;
+}
+
+int engine_start_thread(Board *bp, Channel *commands, Channel *replies, pthread_t *tid)
+{
+    // The caller goes on to change its board, so the engine starts from a copy
+    Board *copy = newbd();
+    copybd(bp, copy);
+    inbox = commands;
+    outbox = replies;
+    if (pthread_create(tid, NULL, engine_thread, copy) != 0) {
+        free(copy);
+        inbox = outbox = NULL;
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,87 @@
+/*
+ * Binary engine protocol frames and sets of legal moves
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+#include "frame.h"
+#include "debug.h"
+
+void frame_make(Frame *f, int type, const Bitboard *bp, Move m)
+{
+    memset(f, 0, sizeof(*f));
+    f->type = type;
+    f->move = m;
+    if (m == 0) {
+        return;
+    }
+    int path[NSQUARES];
+    int n = bb_jump_path(bp, m, path);
+    if (n == 0) {
+        // A step is just its two end points
+        path[0] = SQ_FROM(m);
+        path[1] = SQ_TO(m);
+        n = 2;
+    }
+    if (n > FRAME_MAXPATH) {
+        return;
+    }
+    for (int i = 0; i < n; i++) {
+        f->path[i] = path[i];
+    }
+    f->npath = n;
+}
+
+int frame_print_move(const Frame *f, FILE *s)
+{
+    if (f->npath < 2 || f->npath > FRAME_MAXPATH
+        || f->path[0] != SQ_FROM(f->move) || f->path[f->npath - 1] != SQ_TO(f->move)) {
+        return -1;
+    }
+    fprintf(s, "%s:", ((f->move >> 16) & 1) == X ? "white" : "black");
+    for (int i = 0; i < f->npath; i++) {
+        fprintf(s, "%s%c%d", i > 0 ? "-" : "", 'A' + f->path[i] / BOARD_SIZE, f->path[i] % BOARD_SIZE + 1);
+    }
+    return 0;
+}
+
+// Slot at which to start looking for a move
+static unsigned slot_of(Move m) {
+    return ((uint32_t)m * 2654435761u) >> 21 & (MOVESET_SIZE - 1);
+}
+
+void moveset_fill(MoveSet *ms, const Bitboard *bp)
+{
+    if (ms->filled && ms->key == bp->key) {
+        return;
+    }
+    Move list[MAXMOVES];
+    int n = bb_moves(bp, list);
+    memset(ms->slot, 0, sizeof(ms->slot));
+    for (int i = 0; i < n; i++) {
+        unsigned k = slot_of(list[i]);
+        while (ms->slot[k] != 0 && ms->slot[k] != list[i]) {
+            k = (k + 1) & (MOVESET_SIZE - 1);
+        }
+        ms->slot[k] = list[i];
+    }
+    ms->key = bp->key;
+    ms->filled = 1;
+}
+
+int moveset_legal(MoveSet *ms, const Bitboard *bp, Move m)
+{
+    moveset_fill(ms, bp);
+    if (m == 0) {
+        return 0;
+    }
+    for (unsigned k = slot_of(m); ms->slot[k] != 0; k = (k + 1) & (MOVESET_SIZE - 1)) {
+        if (ms->slot[k] == m) {
+            return 1;
+        }
+    }
+    return 0;
+}
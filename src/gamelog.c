@@ -0,0 +1,237 @@
+/*
+ * Binary game log
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ccheck.h"
+#include "gamelog.h"
+#include "debug.h"
+
+static int write_all(int fd, const void *buf, size_t n) {
+    const char *p = buf;
+    while (n > 0) {
+        ssize_t w = write(fd, p, n);
+        if (w <= 0) {
+            return -1;
+        }
+        p += w;
+        n -= w;
+    }
+    return 0;
+}
+
+// Size of a game whose header is at the given offset, or 0 if there is no
+// complete game there
+static size_t game_size(const char *map, size_t end, uint64_t off) {
+    if (off > end || end - off < sizeof(LogGame)) {
+        return 0;
+    }
+    const LogGame *g = (const LogGame *)(map + off);
+    if (memcmp(g->magic, GAMELOG_GAME, sizeof(g->magic)) != 0
+        || g->nmoves > (end - off - sizeof(LogGame)) / sizeof(LogRecord)) {
+        return 0;
+    }
+    return sizeof(LogGame) + (size_t)g->nmoves * sizeof(LogRecord);
+}
+
+int gamelog_map(const char *path, LogView *view)
+{
+    memset(view, 0, sizeof(*view));
+    int fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        return -1;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == -1) {
+        close(fd);
+        return -1;
+    }
+    view->size = view->end = st.st_size;
+    if (view->size == 0) {
+        close(fd);
+        return 0;
+    }
+    void *m = mmap(NULL, view->size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (m == MAP_FAILED) {
+        return -1;
+    }
+    view->map = m;
+
+    // The index, if the last writer got as far as writing it
+    if (view->size >= sizeof(LogFooter)) {
+        const LogFooter *f = (const LogFooter *)(view->map + view->size - sizeof(LogFooter));
+        size_t room = (view->size - sizeof(LogFooter)) / sizeof(uint64_t);
+        if (memcmp(f->magic, GAMELOG_INDEX, sizeof(f->magic)) == 0 && f->ngames <= room) {
+            view->end = view->size - sizeof(LogFooter) - f->ngames * sizeof(uint64_t);
+            view->offsets = (const uint64_t *)(view->map + view->end);
+            view->ngames = f->ngames;
+            return 0;
+        }
+    }
+
+    // Otherwise walk the headers, as far as the games are complete
+    size_t cap = 0;
+    uint64_t off = 0;
+    for (size_t n; (n = game_size(view->map, view->size, off)) > 0; off += n) {
+        if (view->ngames == cap) {
+            cap = cap ? 2 * cap : 64;
+            uint64_t *s = realloc(view->scanned, cap * sizeof(uint64_t));
+            if (s == NULL) {
+                gamelog_unmap(view);
+                return -1;
+            }
+            view->scanned = s;
+        }
+        view->scanned[view->ngames++] = off;
+    }
+    if (off == 0 && view->size > 0) {
+        // Not a game log at all
+        gamelog_unmap(view);
+        return -1;
+    }
+    view->end = off;
+    view->offsets = view->scanned;
+    return 0;
+}
+
+const LogGame *gamelog_game(const LogView *view, uint64_t i, const LogRecord **records)
+{
+    if (i >= view->ngames || game_size(view->map, view->end, view->offsets[i]) == 0) {
+        return NULL;
+    }
+    const LogGame *g = (const LogGame *)(view->map + view->offsets[i]);
+    *records = (const LogRecord *)(g + 1);
+    return g;
+}
+
+void gamelog_unmap(LogView *view)
+{
+    if (view->map != NULL) {
+        munmap((void *)view->map, view->size);
+    }
+    free(view->scanned);
+    memset(view, 0, sizeof(*view));
+}
+
+// Give up on a log being opened, leaving the file as it was
+static GameLog *discard(GameLog *log) {
+    close(log->fd);
+    free(log->offsets);
+    free(log);
+    return NULL;
+}
+
+GameLog *gamelog_open(const char *path)
+{
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    if (fd == -1) {
+        return NULL;
+    }
+    GameLog *log = calloc(1, sizeof(GameLog));
+    if (log == NULL) {
+        close(fd);
+        return NULL;
+    }
+    log->fd = fd;
+
+    // Take over the games already there, and strip off the index (or
+    // anything a writer left half-written) so that new games follow them
+    LogView view;
+    if (gamelog_map(path, &view) == -1) {
+        return discard(log);
+    }
+    if (view.ngames > 0) {
+        log->offsets = malloc(view.ngames * sizeof(uint64_t));
+        if (log->offsets == NULL) {
+            gamelog_unmap(&view);
+            return discard(log);
+        }
+        memcpy(log->offsets, view.offsets, view.ngames * sizeof(uint64_t));
+        log->ngames = view.ngames;
+    }
+    size_t end = view.end;
+    gamelog_unmap(&view);
+    if (ftruncate(fd, end) == -1 || lseek(fd, end, SEEK_SET) == -1) {
+        return discard(log);
+    }
+    return log;
+}
+
+int gamelog_begin(GameLog *log, int engine_player, const Position *start)
+{
+    off_t off = lseek(log->fd, 0, SEEK_END);
+    uint64_t *offsets = realloc(log->offsets, (log->ngames + 1) * sizeof(uint64_t));
+    if (off == -1 || offsets == NULL) {
+        return -1;
+    }
+    log->offsets = offsets;
+    memset(&log->game, 0, sizeof(log->game));
+    memcpy(log->game.magic, GAMELOG_GAME, sizeof(log->game.magic));
+    log->game.started = time(NULL);
+    log->game.engine_player = engine_player;
+    if (start != NULL) {
+        log->game.start = *start;
+    }
+    if (write_all(log->fd, &log->game, sizeof(log->game)) == -1) {
+        return -1;
+    }
+    log->offsets[log->ngames++] = off;
+    log->in_game = 1;
+    return 0;
+}
+
+int gamelog_move(GameLog *log, const LogRecord *rec)
+{
+    if (!log->in_game || write_all(log->fd, rec, sizeof(*rec)) == -1) {
+        return -1;
+    }
+    // The count goes in once the record is complete, so that a reader never
+    // sees a record that is not all there
+    log->game.nmoves++;
+    off_t at = log->offsets[log->ngames - 1] + offsetof(LogGame, nmoves);
+    if (pwrite(log->fd, &log->game.nmoves, sizeof(log->game.nmoves), at) != sizeof(log->game.nmoves)) {
+        return -1;
+    }
+    return 0;
+}
+
+int gamelog_result(GameLog *log, int result)
+{
+    if (!log->in_game) {
+        return -1;
+    }
+    log->game.result = result;
+    off_t at = log->offsets[log->ngames - 1] + offsetof(LogGame, result);
+    if (pwrite(log->fd, &log->game.result, sizeof(log->game.result), at) != sizeof(log->game.result)) {
+        return -1;
+    }
+    return 0;
+}
+
+int gamelog_close(GameLog *log)
+{
+    int ret = 0;
+    LogFooter f = { .ngames = log->ngames };
+    memcpy(f.magic, GAMELOG_INDEX, sizeof(f.magic));
+    if (lseek(log->fd, 0, SEEK_END) == -1
+        || write_all(log->fd, log->offsets, log->ngames * sizeof(uint64_t)) == -1
+        || write_all(log->fd, &f, sizeof(f)) == -1) {
+        ret = -1;
+    }
+    if (close(log->fd) == -1) {
+        ret = -1;
+    }
+    free(log->offsets);
+    free(log);
+    return ret;
+}
@@ -0,0 +1,198 @@
+/*
+ * Zobrist hashing and transposition table
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "ccheck.h"
+#include "hash.h"
+#include "debug.h"
+
+#define TT_BUCKET 2                       // Entries examined per table slot
+
+// Entries are packed into one 64-bit word so that they can be written and
+// read without locks.  Alongside it is kept the key XORed with that word: an
+// entry torn by two threads storing at once no longer matches any key, so
+// it reads as a miss instead of returning one position's data for another.
+#define MOVE_BITS 20
+#define SCORE_BITS 20
+#define DEPTH_BITS 8
+#define BOUND_BITS 2
+#define SCORE_SHIFT MOVE_BITS
+#define DEPTH_SHIFT (SCORE_SHIFT + SCORE_BITS)
+#define BOUND_SHIFT (DEPTH_SHIFT + DEPTH_BITS)
+#define AGE_SHIFT (BOUND_SHIFT + BOUND_BITS)
+#define FIELD(w, shift, bits) (((w) >> (shift)) & ((1ULL << (bits)) - 1))
+
+typedef struct tt_slot {
+    uint64_t check;                       // Key XOR data
+    uint64_t data;                        // Packed TTEntry fields other than the key
+} TTSlot;
+
+int hash_mb = 16;
+int hash_policy = TT_REPLACE_DEPTH;
+
+HashKey zobrist[2][NSQUARES];
+HashKey zobrist_side;
+
+static TTSlot *table = NULL;
+static size_t nbuckets = 0;
+static unsigned char generation = 0;
+
+// Statistics of the calling thread, reset by tt_reset_stats
+static _Thread_local long tt_probes, tt_hits, tt_stores;
+
+// SplitMix64: fixed seed so that keys (and books keyed by them) are stable
+static uint64_t splitmix64(uint64_t *state) {
+    uint64_t z = (*state += 0x9e3779b97f4a7c15ULL);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+    return z ^ (z >> 31);
+}
+
+void hash_init(void)
+{
+    static int initialized = 0;
+    if (initialized) {
+        return;
+    }
+    uint64_t state = 0x636368656b6b6579ULL;
+    for (int p = 0; p < 2; p++) {
+        for (int sq = 0; sq < NSQUARES; sq++) {
+            zobrist[p][sq] = splitmix64(&state);
+        }
+    }
+    zobrist_side = splitmix64(&state);
+    initialized = 1;
+}
+
+int tt_init(void)
+{
+    hash_init();
+    size_t bytes = (size_t)(hash_mb > 0 ? hash_mb : 1) << 20;
+    size_t n = 1;
+    // Round down to a power of two so that slots can be selected by masking
+    while (n * 2 * TT_BUCKET * sizeof(TTSlot) <= bytes) {
+        n *= 2;
+    }
+
+    TTSlot *t = calloc(n * TT_BUCKET, sizeof(TTSlot));
+    if (t == NULL) {
+        return -1;
+    }
+    free(table);
+    table = t;
+    nbuckets = n;
+    generation = 0;
+    debug("Transposition table: %zu buckets of %d entries", nbuckets, TT_BUCKET);
+    return 0;
+}
+
+void tt_new_search(void)
+{
+    generation++;
+    tt_reset_stats();
+}
+
+void tt_reset_stats(void)
+{
+    tt_probes = tt_hits = tt_stores = 0;
+}
+
+static uint64_t pack(const TTEntry *e) {
+    return (uint64_t)(e->move & ((1U << MOVE_BITS) - 1))
+        | (uint64_t)(e->score + (1 << (SCORE_BITS - 1))) << SCORE_SHIFT
+        | (uint64_t)e->depth << DEPTH_SHIFT
+        | (uint64_t)e->bound << BOUND_SHIFT
+        | (uint64_t)e->age << AGE_SHIFT;
+}
+
+// Read a slot, which other threads may be writing at the same time
+static void load(TTSlot *slot, TTEntry *e) {
+    uint64_t data = __atomic_load_n(&slot->data, __ATOMIC_RELAXED);
+    uint64_t check = __atomic_load_n(&slot->check, __ATOMIC_RELAXED);
+    e->key = check ^ data;
+    e->move = FIELD(data, 0, MOVE_BITS);
+    e->score = (int)FIELD(data, SCORE_SHIFT, SCORE_BITS) - (1 << (SCORE_BITS - 1));
+    e->depth = FIELD(data, DEPTH_SHIFT, DEPTH_BITS);
+    e->bound = FIELD(data, BOUND_SHIFT, BOUND_BITS);
+    e->age = FIELD(data, AGE_SHIFT, 8);
+}
+
+int tt_probe(HashKey key, TTEntry *e)
+{
+    if (table == NULL) {
+        return 0;
+    }
+    tt_probes++;
+    TTSlot *bucket = &table[(key & (nbuckets - 1)) * TT_BUCKET];
+    for (int i = 0; i < TT_BUCKET; i++) {
+        load(&bucket[i], e);
+        if (e->key == key && e->bound <= TT_UPPER && e->depth > 0) {
+            tt_hits++;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+void tt_store(HashKey key, Move move, int score, int depth, int bound)
+{
+    if (table == NULL) {
+        return;
+    }
+    TTSlot *bucket = &table[(key & (nbuckets - 1)) * TT_BUCKET];
+    TTEntry entries[TT_BUCKET];
+    int victim = -1;
+
+    for (int i = 0; i < TT_BUCKET; i++) {
+        load(&bucket[i], &entries[i]);
+    }
+
+    if (hash_policy == TT_REPLACE_ALWAYS) {
+        // One fixed entry per key: the newest result always wins
+        victim = (key >> 32) % TT_BUCKET;
+    } else {
+        for (int i = 0; i < TT_BUCKET; i++) {
+            if (entries[i].key == key) {
+                victim = i;
+                break;
+            }
+        }
+        if (victim != -1) {
+            // Same position: don't let a shallow bound destroy a deeper result
+            TTEntry *v = &entries[victim];
+            if (depth < v->depth && bound != TT_EXACT && v->age == generation) {
+                return;
+            }
+            if (move == 0) {
+                move = v->move;
+            }
+        } else {
+            // Prefer entries from earlier searches, then the shallowest one
+            for (int i = 0; i < TT_BUCKET; i++) {
+                TTEntry *e = &entries[i];
+                if (victim == -1) {
+                    victim = i;
+                } else if ((e->age != generation) > (entries[victim].age != generation)) {
+                    victim = i;
+                } else if ((e->age != generation) == (entries[victim].age != generation)
+                         && e->depth < entries[victim].depth) {
+                    victim = i;
+                }
+            }
+        }
+    }
+
+    TTEntry e = { key, move, score, depth, bound, generation };
+    uint64_t data = pack(&e);
+    __atomic_store_n(&bucket[victim].data, data, __ATOMIC_RELAXED);
+    __atomic_store_n(&bucket[victim].check, key ^ data, __ATOMIC_RELAXED);
+    tt_stores++;
+}
+
+void tt_print_stats(void)
+{
+    fprintf(stderr, "TT: %ld/%ld hits, %ld stores\n", tt_hits, tt_probes, tt_stores);
+}
@@ -0,0 +1,175 @@
+/*
+ * Learned evaluation
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "nnue.h"
+#include "debug.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HAVE_X86 1
+#endif
+
+_Static_assert(NNUE_HIDDEN % 16 == 0, "the kernels handle the accumulator 16 sums at a time");
+
+const Network *nnue_net;
+void (*nnue_update)(int16_t *acc, const int16_t *add, const int16_t *sub);
+
+static int (*output_kernel)(const int16_t *acc, const int16_t *w2);
+static const char *kernel_name;
+static Network loaded;                    // The network read by nnue_load
+
+static void update_scalar(int16_t *acc, const int16_t *add, const int16_t *sub) {
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        acc[i] += add[i] - sub[i];
+    }
+}
+
+static int output_scalar(const int16_t *acc, const int16_t *w2) {
+    int sum = 0;
+    for (int i = 0; i < NNUE_HIDDEN; i++) {
+        int a = acc[i] < 0 ? 0 : acc[i] > NNUE_QA ? NNUE_QA : acc[i];
+        sum += a * w2[i];
+    }
+    return sum;
+}
+
+#ifdef HAVE_X86
+__attribute__((target("sse2")))
+static void update_sse2(int16_t *acc, const int16_t *add, const int16_t *sub) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+        a = _mm_add_epi16(a, _mm_loadu_si128((const __m128i *)(add + i)));
+        a = _mm_sub_epi16(a, _mm_loadu_si128((const __m128i *)(sub + i)));
+        _mm_storeu_si128((__m128i *)(acc + i), a);
+    }
+}
+
+__attribute__((target("sse2")))
+static int output_sse2(const int16_t *acc, const int16_t *w2) {
+    const __m128i zero = _mm_setzero_si128(), top = _mm_set1_epi16(NNUE_QA);
+    __m128i sum = _mm_setzero_si128();
+    for (int i = 0; i < NNUE_HIDDEN; i += 8) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(acc + i));
+        a = _mm_min_epi16(_mm_max_epi16(a, zero), top);
+        // Products of neighboring pairs, added into 32-bit sums
+        sum = _mm_add_epi32(sum, _mm_madd_epi16(a, _mm_loadu_si128((const __m128i *)(w2 + i))));
+    }
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+    sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(sum);
+}
+
+__attribute__((target("avx2")))
+static void update_avx2(int16_t *acc, const int16_t *add, const int16_t *sub) {
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+        a = _mm256_add_epi16(a, _mm256_loadu_si256((const __m256i *)(add + i)));
+        a = _mm256_sub_epi16(a, _mm256_loadu_si256((const __m256i *)(sub + i)));
+        _mm256_storeu_si256((__m256i *)(acc + i), a);
+    }
+}
+
+__attribute__((target("avx2")))
+static int output_avx2(const int16_t *acc, const int16_t *w2) {
+    const __m256i zero = _mm256_setzero_si256(), top = _mm256_set1_epi16(NNUE_QA);
+    __m256i sum = _mm256_setzero_si256();
+    for (int i = 0; i < NNUE_HIDDEN; i += 16) {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(acc + i));
+        a = _mm256_min_epi16(_mm256_max_epi16(a, zero), top);
+        sum = _mm256_add_epi32(sum, _mm256_madd_epi16(a, _mm256_loadu_si256((const __m256i *)(w2 + i))));
+    }
+    __m128i s = _mm_add_epi32(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(1, 0, 3, 2)));
+    s = _mm_add_epi32(s, _mm_shuffle_epi32(s, _MM_SHUFFLE(2, 3, 0, 1)));
+    return _mm_cvtsi128_si32(s);
+}
+#endif
+
+// Pick the widest kernels the processor can run
+static void select_kernels(void) {
+    nnue_update = update_scalar;
+    output_kernel = output_scalar;
+    kernel_name = "scalar";
+#ifdef HAVE_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        nnue_update = update_avx2;
+        output_kernel = output_avx2;
+        kernel_name = "avx2";
+    } else if (__builtin_cpu_supports("sse2")) {
+        nnue_update = update_sse2;
+        output_kernel = output_sse2;
+        kernel_name = "sse2";
+    }
+#endif
+}
+
+void nnue_use(const Network *net)
+{
+    if (kernel_name == NULL) {
+        select_kernels();
+    }
+    nnue_net = net;
+}
+
+int nnue_load(const char *path)
+{
+    FILE *f = fopen(path, "rb");
+    if (f == NULL) {
+        return -1;
+    }
+    NnueHeader hdr;
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 || memcmp(hdr.magic, NNUE_MAGIC, sizeof(hdr.magic)) != 0
+        || hdr.features != NNUE_FEATURES || hdr.hidden != NNUE_HIDDEN
+        || fread(&loaded, sizeof(loaded), 1, f) != 1) {
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    nnue_use(&loaded);
+    debug("Loaded network %s (%s kernels)", path, kernel_name);
+    return 0;
+}
+
+int nnue_save(const char *path, const Network *net)
+{
+    FILE *f = fopen(path, "wb");
+    if (f == NULL) {
+        return -1;
+    }
+    NnueHeader hdr = { NNUE_MAGIC, NNUE_FEATURES, NNUE_HIDDEN };
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 || fwrite(net, sizeof(*net), 1, f) != 1) {
+        fclose(f);
+        return -1;
+    }
+    return fclose(f);
+}
+
+const char *nnue_kernel_name(void)
+{
+    if (kernel_name == NULL) {
+        select_kernels();
+    }
+    return kernel_name;
+}
+
+void nnue_refresh(int16_t *acc, const int *features, int n)
+{
+    memcpy(acc, nnue_net->b1, sizeof(nnue_net->b1));
+    for (int i = 0; i < n; i++) {
+        for (int j = 0; j < NNUE_HIDDEN; j++) {
+            acc[j] += nnue_net->w1[features[i]][j];
+        }
+    }
+}
+
+int nnue_output(const int16_t *acc, int tomove)
+{
+    long sum = (long)output_kernel(acc, nnue_net->w2) + nnue_net->b2[tomove];
+    return sum * NNUE_SCALE / (NNUE_QA * NNUE_QB);
+}
@@ -0,0 +1,165 @@
+/*
+ * Line-buffered connections to the child processes
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <unistd.h>
+
+#include "peer.h"
+#include "debug.h"
+
+// Write all of a command and wake the child up to read it
+static int transmit(Peer *p, const char *cmd, size_t n) {
+    // Only one command is ever in the pipe at a time, so the writes are
+    // far too short to fill it and need no buffering of their own
+    while (n > 0) {
+        ssize_t w = write(p->out, cmd, n);
+        if (w == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return -1;
+        }
+        cmd += w;
+        n -= w;
+    }
+    return 0;
+}
+
+int peer_start(Peer *p, const char *name, pid_t pid, int in, int out)
+{
+    memset(p, 0, sizeof(*p));
+    p->name = name;
+    p->pid = pid;
+    p->in = in;
+    p->out = out;
+    p->awaiting = PEER_HELLO;
+    int flags = fcntl(in, F_GETFL);
+    if (flags == -1 || fcntl(in, F_SETFL, flags | O_NONBLOCK) == -1) {
+        return -1;
+    }
+    return 0;
+}
+
+// Send a command of n bytes, or queue it
+static int send_command(Peer *p, const char *cmd, size_t n) {
+    if (n == 0 || n > PEER_BUFSIZE) {
+        return -1;
+    }
+    if (p->awaiting) {
+        char *q = realloc(p->queue, p->queued + n);
+        if (q == NULL) {
+            return -1;
+        }
+        memcpy(q + p->queued, cmd, n);
+        p->queue = q;
+        p->queued += n;
+        return 0;
+    }
+    if (transmit(p, cmd, n) == -1) {
+        return -1;
+    }
+    p->awaiting = cmd[0];
+    kill(p->pid, SIGHUP);
+    return 0;
+}
+
+int peer_send(Peer *p, const char *cmd)
+{
+    return send_command(p, cmd, strlen(cmd));
+}
+
+int peer_send_frame(Peer *p, const void *frame)
+{
+    return send_command(p, frame, p->framed);
+}
+
+// Length of the first line or frame in a buffer, or 0 if it is incomplete
+static size_t record_length(Peer *p, const char *buf, size_t len) {
+    if (p->framed) {
+        return len >= p->framed ? p->framed : 0;
+    }
+    char *nl = memchr(buf, '\n', len);
+    return nl != NULL ? nl - buf + 1 : 0;
+}
+
+int peer_fill(Peer *p)
+{
+    while (p->len < PEER_BUFSIZE) {
+        ssize_t r = read(p->in, p->buf + p->len, PEER_BUFSIZE - p->len);
+        if (r > 0) {
+            p->len += r;
+        } else if (r == 0) {
+            return -1;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            return 0;
+        } else if (errno != EINTR) {
+            return -1;
+        }
+    }
+    // A full buffer is fine as long as a line can be taken from it
+    return record_length(p, p->buf, p->len) > 0 ? 0 : -1;
+}
+
+int peer_reply(Peer *p, char *line, int *cmd)
+{
+    int n = record_length(p, p->buf, p->len);
+    if (n == 0) {
+        return 0;
+    }
+    memcpy(line, p->buf, n);
+    line[n] = '\0';
+    memmove(p->buf, p->buf + n, p->len - n);
+    p->len -= n;
+    *cmd = p->awaiting;
+    p->awaiting = 0;
+
+    // The next queued command, if any, may go now
+    if (p->queued > 0) {
+        size_t k = record_length(p, p->queue, p->queued);
+        char next[PEER_BUFSIZE];
+        memcpy(next, p->queue, k);
+        memmove(p->queue, p->queue + k, p->queued - k);
+        p->queued -= k;
+        if (send_command(p, next, k) == -1) {
+            return -1;
+        }
+    }
+    return 1;
+}
+
+int peer_wait(Peer *p, char *line, int *cmd)
+{
+    while (1) {
+        int r = peer_reply(p, line, cmd);
+        if (r != 0) {
+            return r;
+        }
+        struct pollfd pfd = { .fd = p->in, .events = POLLIN };
+        if (poll(&pfd, 1, -1) == -1 && errno != EINTR) {
+            return -1;
+        }
+        if (peer_fill(p) == -1 && record_length(p, p->buf, p->len) == 0) {
+            return -1;
+        }
+    }
+}
+
+void peer_close(Peer *p)
+{
+    if (p->in != -1) {
+        close(p->in);
+    }
+    if (p->out != -1) {
+        close(p->out);
+    }
+    p->in = p->out = -1;
+    free(p->queue);
+    p->queue = NULL;
+    p->queued = 0;
+}
@@ -0,0 +1,201 @@
+/*
+ * Compact encodings of game positions
+ */
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+#include "position.h"
+#include "debug.h"
+
+#define ONBOARD ((BIT(NSQUARES)) - 1)     // Every hole on the board
+#define TOMOVE_BIT 127                    // Set if O is to move
+
+static void to_bytes(Bits code, Position *pos) {
+    for (int i = 0; i < POSITION_BYTES; i++) {
+        pos->bytes[i] = (uint8_t)(code >> (8 * i));
+    }
+}
+
+static Bits from_bytes(const Position *pos) {
+    Bits code = 0;
+    for (int i = 0; i < POSITION_BYTES; i++) {
+        code |= (Bits)pos->bytes[i] << (8 * i);
+    }
+    return code;
+}
+
+// Encode the holes held by each side and the side to move
+static int pack(Bits white, Bits black, Player tomove, Position *pos) {
+    Bits occupied = white | black;
+    if (count_squares(occupied) > POSITION_MAXPIECES) {
+        return -1;
+    }
+    Bits code = occupied;
+    int owner = NSQUARES;
+    for (Bits b = occupied; b != 0; b &= b - 1, owner++) {
+        if (black & BIT(first_square(b))) {
+            code |= BIT(owner);
+        }
+    }
+    if (tomove == O) {
+        code |= BIT(TOMOVE_BIT);
+    }
+    to_bytes(code, pos);
+    return 0;
+}
+
+int bb_encode(const Bitboard *bp, Position *pos)
+{
+    return pack(bp->pieces[X], bp->pieces[O], bp->tomove, pos);
+}
+
+int bb_decode(const Position *pos, Bitboard *bp)
+{
+    Bits code = from_bytes(pos);
+    Bits occupied = code & ONBOARD;
+    int n = count_squares(occupied);
+    if (n > POSITION_MAXPIECES) {
+        return -1;
+    }
+    // Only the owner bits of the pieces there are may be set
+    Bits owners = code >> NSQUARES & (BIT(n) - 1);
+    if ((code & ~ONBOARD & ~BIT(TOMOVE_BIT)) != owners << NSQUARES) {
+        return -1;
+    }
+    Bits white = 0, black = 0;
+    for (Bits b = occupied; b != 0; b &= b - 1, owners >>= 1) {
+        if (owners & 1) {
+            black |= BIT(first_square(b));
+        } else {
+            white |= BIT(first_square(b));
+        }
+    }
+    bb_setup(bp, white, black, code & BIT(TOMOVE_BIT) ? O : X);
+    return 0;
+}
+
+int encode_bd(Board *bp, Position *pos)
+{
+    Bitboard bb;
+    if (bb_from_board(bp, &bb) == -1) {
+        return -1;
+    }
+    return bb_encode(&bb, pos);
+}
+
+// A move of a piece from one hole to another, which need not be legal
+static Move lift(Player p, int from, int to) {
+    return (Move)p << 16 | (from / BOARD_SIZE) << 12 | (from % BOARD_SIZE) << 8
+        | (to / BOARD_SIZE) << 4 | (to % BOARD_SIZE);
+}
+
+// Make a move on both the board and the bitboard that tracks it, passing
+// first if it is the other side's turn
+static void make(Board *board, Bitboard *cur, Player p, int from, int to) {
+    if (cur->tomove != p) {
+        // A move from a hole to itself leaves the piece where it is
+        int sq = first_square(cur->pieces[cur->tomove]);
+        apply(board, lift(cur->tomove, sq, sq));
+        bb_apply(cur, lift(cur->tomove, sq, sq));
+    }
+    apply(board, lift(p, from, to));
+    bb_apply(cur, lift(p, from, to));
+}
+
+Board *decode_bd(const Position *pos)
+{
+    Bitboard want, cur;
+    bb_newbd(&cur);
+    if (bb_decode(pos, &want) == -1
+        || count_squares(want.pieces[X]) != count_squares(cur.pieces[X])
+        || count_squares(want.pieces[O]) != count_squares(cur.pieces[O])) {
+        return NULL;
+    }
+
+    Board *board = newbd();
+    while (1) {
+        Bits need[2] = { want.pieces[X] & ~cur.pieces[X], want.pieces[O] & ~cur.pieces[O] };
+        if (need[X] == 0 && need[O] == 0) {
+            break;
+        }
+        Bits empty = ONBOARD & ~(cur.pieces[X] | cur.pieces[O]);
+        Player p = need[X] & empty ? X : O;
+        if (need[p] & empty) {
+            // Fill an empty hole from a piece of the side that is out of place
+            int to = first_square(need[p] & empty);
+            int from = first_square(cur.pieces[p] & ~want.pieces[p]);
+            make(board, &cur, p, from, to);
+        } else {
+            // Every hole still to be filled holds a piece that has to leave:
+            // move one of them aside to a hole that nobody wants
+            int from = first_square(need[X] ? need[X] : need[O]);
+            p = cur.pieces[X] & BIT(from) ? X : O;
+            int to = first_square(empty & ~want.pieces[X] & ~want.pieces[O]);
+            make(board, &cur, p, from, to);
+        }
+    }
+    if (cur.tomove != want.tomove) {
+        int sq = first_square(cur.pieces[cur.tomove]);
+        apply(board, lift(cur.tomove, sq, sq));
+    }
+    return board;
+}
+
+int position_print(const Position *pos, FILE *s)
+{
+    Bitboard bb;
+    if (bb_decode(pos, &bb) == -1) {
+        return -1;
+    }
+    for (int r = 0; r < BOARD_SIZE; r++) {
+        int run = 0;
+        for (int c = 0; c < BOARD_SIZE; c++) {
+            Bits hole = BIT(r * BOARD_SIZE + c);
+            if (!((bb.pieces[X] | bb.pieces[O]) & hole)) {
+                run++;
+                continue;
+            }
+            if (run > 0) {
+                fprintf(s, "%d", run);
+            }
+            run = 0;
+            fputc(bb.pieces[X] & hole ? 'W' : 'B', s);
+        }
+        if (run > 0) {
+            fprintf(s, "%d", run);
+        }
+        fputc('/', s);
+    }
+    fputc(bb.tomove == X ? 'w' : 'b', s);
+    return 0;
+}
+
+int position_parse(const char *text, Position *pos)
+{
+    Bits white = 0, black = 0;
+    const char *cp = text;
+    for (int r = 0; r < BOARD_SIZE; r++) {
+        int c = 0;
+        for (; c < BOARD_SIZE && *cp != '/' && *cp != '\0'; cp++) {
+            if (*cp >= '1' && *cp <= '9') {
+                c += *cp - '0';
+            } else if (*cp == 'W') {
+                white |= BIT(r * BOARD_SIZE + c++);
+            } else if (*cp == 'B') {
+                black |= BIT(r * BOARD_SIZE + c++);
+            } else {
+                return -1;
+            }
+        }
+        if (c != BOARD_SIZE || *cp++ != '/') {
+            return -1;
+        }
+    }
+    if ((cp[0] != 'w' && cp[0] != 'b') || cp[1] != '\0') {
+        return -1;
+    }
+    return pack(white, black, cp[0] == 'w' ? X : O, pos);
+}
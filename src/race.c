@@ -0,0 +1,167 @@
+/*
+ * Race solver: shortest paths home by IDA* once the armies have disengaged
+ */
+
+#include <string.h>
+
+#include "ccheck.h"
+#include "race.h"
+#include "search.h"
+#include "timectl.h"
+#include "debug.h"
+
+#define GOAL_LEVEL 140                    // Sum of levels of the ten holes of the target
+#define MAX_GAIN 16                       // Most levels one move can gain (corner to corner)
+#define CACHE_SIZE (1 << 16)              // Entries in the cache of lower bounds
+#define POLL_NODES 4096                   // Positions between checks of stop_search and the clock
+
+// A position already shown to need at least "bound" more moves
+typedef struct race_entry {
+    HashKey key;
+    int bound;
+} RaceEntry;
+
+static RaceEntry cache[CACHE_SIZE];
+static Move lists[RACE_MAXLEN][MAXMOVES]; // Move lists, one per move of the race
+static Move path[RACE_MAXLEN];            // Race being tried
+static long race_nodes, race_limit;
+static long race_deadline;                // clock_ms() at which to give up, or 0 for never
+
+// How far a hole is along the way to a player's target corner, 0 to 16
+static int level(Player p, int sq) {
+    int l = sq / BOARD_SIZE + sq % BOARD_SIZE;
+    return p == X ? l : 2 * (BOARD_SIZE - 1) - l;
+}
+
+static int gain(Move m) {
+    Player p = (m >> 16) & 1;
+    return level(p, SQ_TO(m)) - level(p, SQ_FROM(m));
+}
+
+// Admissible estimate of the moves still needed: each piece outside the
+// target needs a move of its own, and no move gains more than MAX_GAIN levels
+static int estimate(const Bitboard *bp, Player p) {
+    int outside = count_squares(bp->pieces[p] & ~home[1 - p]);
+    int levels = 0;
+    for (Bits b = bp->pieces[p]; b != 0; b &= b - 1) {
+        levels += level(p, first_square(b));
+    }
+    int h = (GOAL_LEVEL - levels + MAX_GAIN - 1) / MAX_GAIN;
+    return outside > h ? outside : h;
+}
+
+// Make a move without passing the turn, so that one side moves throughout
+static void play(Bitboard *bp, Move m) {
+    bb_apply(bp, m);
+    bp->tomove = 1 - bp->tomove;
+    bp->key ^= zobrist_side;
+    bp->moveno--;
+}
+
+static void unplay(Bitboard *bp, Move m) {
+    bp->tomove = 1 - bp->tomove;
+    bp->key ^= zobrist_side;
+    bp->moveno++;
+    bb_undo(bp, m);
+}
+
+// Depth-first search for a race of at most "bound" moves, g having been made.
+// Returns 1 if one was found (in path), 0 if there is none, -1 to give up.
+static int ida(Bitboard *bp, Player p, int g, int bound) {
+    if (bp->pieces[p] == home[1 - p]) {
+        return 1;
+    }
+    if (g + estimate(bp, p) > bound) {
+        return 0;
+    }
+    RaceEntry *e = &cache[bp->key & (CACHE_SIZE - 1)];
+    if (e->key == bp->key && g + e->bound > bound) {
+        return 0;
+    }
+    if (++race_nodes > race_limit) {
+        return -1;
+    }
+    if (race_nodes % POLL_NODES == 0
+        && (stop_search || (race_deadline != 0 && clock_ms() >= race_deadline))) {
+        return -1;
+    }
+
+    // Drop retreats, and try the moves that gain the most first (insertion
+    // sorted in place: the lists are short)
+    Move *list = lists[g];
+    int count = bb_moves(bp, list);
+    int n = 0;
+    for (int i = 0; i < count; i++) {
+        Move m = list[i];
+        int k = gain(m);
+        if (k < 0) {
+            continue;
+        }
+        int j = n++;
+        for (; j > 0 && gain(list[j - 1]) < k; j--) {
+            list[j] = list[j - 1];
+        }
+        list[j] = m;
+    }
+
+    for (int i = 0; i < n; i++) {
+        path[g] = list[i];
+        play(bp, list[i]);
+        int r = ida(bp, p, g + 1, bound);
+        unplay(bp, list[i]);
+        if (r != 0) {
+            return r;
+        }
+    }
+    // Nothing within the bound: at least one more move is needed from here
+    e->key = bp->key;
+    e->bound = bound - g + 1;
+    return 0;
+}
+
+int race_detect(const Bitboard *bp)
+{
+    int xmin = 2 * (BOARD_SIZE - 1), omax = 0;
+    for (Bits b = bp->pieces[X]; b != 0; b &= b - 1) {
+        int l = level(X, first_square(b));
+        if (l < xmin) {
+            xmin = l;
+        }
+    }
+    for (Bits b = bp->pieces[O]; b != 0; b &= b - 1) {
+        int l = level(X, first_square(b));
+        if (l > omax) {
+            omax = l;
+        }
+    }
+    return xmin > omax;
+}
+
+int race_moves(const Bitboard *bp, Player p, Move *first, long limit, long ms)
+{
+    Bitboard pos;
+    bb_copybd(bp, &pos);
+    if (pos.tomove != p) {
+        pos.tomove = p;
+        pos.key ^= zobrist_side;
+    }
+    memset(cache, 0, sizeof(cache));
+    race_nodes = 0;
+    race_limit = limit;
+    race_deadline = ms > 0 ? clock_ms() + ms : 0;
+
+    // Deepen the bound one move at a time, so the first race found is shortest
+    for (int bound = estimate(&pos, p); bound <= RACE_MAXLEN; bound++) {
+        int r = ida(&pos, p, 0, bound);
+        if (r == -1) {
+            break;
+        }
+        if (r == 1) {
+            *first = bound > 0 ? path[0] : 0;
+            debug("Race for %s: %d moves, %ld positions", p == X ? "white" : "black", bound,
+                  race_nodes);
+            return bound;
+        }
+    }
+    return -1;
+}
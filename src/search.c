@@ -0,0 +1,581 @@
+/*
+ * Alpha/beta search with a transposition table, shared by helper threads
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <signal.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <time.h>
+
+#include "ccheck.h"
+#include "search.h"
+#include "debug.h"
+
+// Library statistics, fed from the main thread's counters
+extern int nodes, stepgens, steptot, jumpgens, jumptot;
+
+#define POLL_NODES 128                    // Nodes between checks for a stop request
+                                          // (a millisecond or two; the clock read is cheap)
+
+// Move ordering: forward jumps, then killers, then everything else by
+// history score.  Each stage's scores lie above those of the next.
+#define ORDER_JUMP (3 << 24)
+#define ORDER_KILLER (2 << 24)
+#define HISTORY_MAX (1 << 18)             // History scores are halved beyond this
+
+int search_threads = 1;
+int max_depth = MAXPLY;
+int search_algorithm = SEARCH_ALPHABETA;
+volatile sig_atomic_t stop_search = 0;
+int search_status = SEARCH_COMPLETE;
+long search_nodes;
+int (*search_interrupt)(void) = NULL;
+
+// A move with its place in the search order
+typedef struct scored_move {
+    Move move;
+    int score;
+} ScoredMove;
+
+// Working storage for one ply of the search.  A position has at most one
+// move per piece and destination, far fewer than MAXMOVES, so the lists
+// cannot overflow.
+typedef struct ply_frame {
+    Move moves[MAXMOVES];                 // Moves as generated
+    ScoredMove list[MAXMOVES];            // The same moves in search order
+    Move *line;                           // Row of the PV triangle: best line found
+                                          // by the child, indexed by ply
+    Move killers[2];                      // Recent cutoff moves at this ply
+} PlyFrame;
+
+// State of one thread's search
+typedef struct search_context {
+    Bitboard pos;                         // Position being searched
+    int depth;                            // Depth cutoff in ply
+    int helper;                           // Nonzero for helper threads
+    int aborted;                          // Main thread has been told to stop
+    Move rootmove;                        // Best root move found so far
+    long nodes;                           // Positions evaluated (helpers, when done)
+    Move prevpv[MAXDEPTH + 1];            // Principal variation of the previous iteration
+    int pvply;                            // Plies of prevpv leading to the current node
+    int history[2][NSQUARES][NSQUARES];   // Cutoff credit by player, origin, destination
+    long cutoffs, firstcutoffs;           // Beta cutoffs, and those by the first move tried
+    PlyFrame *frames;                     // Arena of per-ply storage, frames[0..plies]
+    Move *triangle;                       // PV rows for the frames
+    int plies;                            // Depth the arena has room for
+    Move *rootpv;                         // Principal variation found at the root
+    long researches;                      // PVS re-searches after null-window fail highs
+    long research_nodes;                  // Positions evaluated in those re-searches
+} SearchContext;
+
+static SearchContext main_ctx;
+static SearchContext helper_ctx[MAXTHREADS];
+static pthread_t helper_tid[MAXTHREADS];
+static int nhelpers;                      // Helper threads currently running
+static atomic_int stop_helpers;
+static long helper_nodes;                 // Positions evaluated by helpers, last search
+static long search_ms;                    // Wall time of the last search
+static struct timespec deadline;          // When the main thread must stop, if has_deadline
+static int has_deadline;
+
+// Forward progress of a move for the player making it
+static int progress(Move m) {
+    int p = (row_to(m) - row_from(m)) + (col_to(m) - col_from(m));
+    return ((m >> 16) & 1) == X ? p : -p;
+}
+
+static int compare_scored(const void *a, const void *b) {
+    int x = ((const ScoredMove *)a)->score, y = ((const ScoredMove *)b)->score;
+    return (y > x) - (y < x);
+}
+
+// Collect the legal moves for the side to move, except "skip" (which has been
+// searched already), in the order they are to be searched: jumps that make
+// forward progress, furthest first; then the killer moves for ply d; then the
+// rest by history score, with progress breaking ties.
+static int generate(SearchContext *ctx, int d, Move skip) {
+    Move *moves = ctx->frames[d].moves;
+    ScoredMove *list = ctx->frames[d].list;
+    int njumps = bb_jump_moves(&ctx->pos, moves);
+    int n = njumps + bb_step_moves(&ctx->pos, moves + njumps);
+    int k = 0;
+
+    for (int i = 0; i < n; i++) {
+        Move m = moves[i];
+        if (m == skip) {
+            continue;
+        }
+        int score;
+        if (i < njumps && progress(m) > 0) {
+            score = ORDER_JUMP + progress(m);
+        } else if (m == ctx->frames[d].killers[0]) {
+            score = ORDER_KILLER + 1;
+        } else if (m == ctx->frames[d].killers[1]) {
+            score = ORDER_KILLER;
+        } else {
+            score = ctx->history[(m >> 16) & 1][SQ_FROM(m)][SQ_TO(m)] * 32 + progress(m) + 16;
+        }
+        list[k].move = m;
+        list[k].score = score;
+        k++;
+    }
+    qsort(list, k, sizeof(ScoredMove), compare_scored);
+    return k;
+}
+
+// Whether a move from the table or the previous principal variation can be
+// tried in the current position before any moves have been generated.  Such a
+// move was legal in this same position, so it is enough to weed out null
+// moves and the (astronomically unlikely) hash collision.
+static int usable(const Bitboard *pos, Player p, Move m) {
+    return m != 0 && SQ_FROM(m) != SQ_TO(m) && ((m >> 16) & 1) == p
+        && (pos->pieces[p] & BIT(SQ_FROM(m))) && !(pos->pieces[p] & BIT(SQ_TO(m)));
+}
+
+// Credit a move that caused a beta cutoff at ply d, with "remaining" ply to go
+static void record_cutoff(SearchContext *ctx, int d, Player p, Move m, int remaining, int first) {
+    ctx->cutoffs++;
+    if (first) {
+        ctx->firstcutoffs++;
+    }
+    Move *killers = ctx->frames[d].killers;
+    if (m != killers[0]) {
+        killers[1] = killers[0];
+        killers[0] = m;
+    }
+    int *h = &ctx->history[p][SQ_FROM(m)][SQ_TO(m)];
+    *h += remaining * remaining;
+    if (*h > HISTORY_MAX) {
+        for (int from = 0; from < NSQUARES; from++) {
+            for (int to = 0; to < NSQUARES; to++) {
+                ctx->history[p][from][to] /= 2;
+            }
+        }
+    }
+}
+
+// Fill in the principal variation from ply d by following moves stored in
+// the transposition table, padding with null moves where the table runs out.
+static void pv_from_table(SearchContext *ctx, int d, Player p, Move *pvar) {
+    Bitboard *pos = &ctx->pos;
+    int made = d;
+    TTEntry e;
+    for (; made < ctx->depth; made++) {
+        if (!tt_probe(pos->key, &e) || e.move == 0 || !(pos->pieces[p] & BIT(SQ_FROM(e.move)))) {
+            break;
+        }
+        pvar[made] = e.move;
+        bb_apply(pos, e.move);
+        p = 1 - p;
+    }
+    for (int i = made; i < ctx->depth; i++) {
+        pvar[i] = NULL_MOVE(p);
+        p = 1 - p;
+    }
+    while (made > d) {
+        made--;
+        bb_undo(pos, pvar[made]);
+    }
+}
+
+static int stopped(SearchContext *ctx) {
+    if (ctx->helper) {
+        return atomic_load_explicit(&stop_helpers, memory_order_relaxed);
+    }
+    return ctx->aborted;
+}
+
+// Every POLL_NODES nodes, the main thread checks for a stop request and for
+// the deadline.  Between checks it runs undisturbed.
+static void poll(SearchContext *ctx) {
+    if (ctx->helper || bb_stats.nodes % POLL_NODES != 0) {
+        return;
+    }
+    if (stop_search || (search_interrupt != NULL && search_interrupt())) {
+        ctx->aborted = 1;
+    } else if (has_deadline) {
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if (now.tv_sec > deadline.tv_sec
+            || (now.tv_sec == deadline.tv_sec && now.tv_nsec >= deadline.tv_nsec)) {
+            ctx->aborted = 1;
+        }
+    }
+}
+
+static int alphabeta(SearchContext *ctx, int d, Player p, Move *pvar, int alpha, int beta) {
+    Bitboard *pos = &ctx->pos;
+    int score = bb_eval(pos, p);
+    poll(ctx);
+    if (stopped(ctx)) {
+        return 0;
+    }
+    if (d == ctx->depth) {
+        return score;
+    }
+
+    // Game already decided: nothing more to search
+    if (score == WINEVAL || score == -WINEVAL) {
+        for (int i = d; i < ctx->depth; i++) {
+            pvar[i] = NULL_MOVE(p);
+            p = 1 - p;
+        }
+        return score;
+    }
+
+    int remaining = ctx->depth - d;
+    int alpha0 = alpha;
+    Move hashmove = 0;
+    TTEntry e;
+    if (tt_probe(pos->key, &e)) {
+        hashmove = e.move;
+        if (d > 0 && e.depth >= remaining
+            && (e.bound == TT_EXACT
+                || (e.bound == TT_LOWER && e.score >= beta)
+                || (e.bound == TT_UPPER && e.score <= alpha))) {
+            pv_from_table(ctx, d, p, pvar);
+            return e.score;
+        }
+    }
+    // Without a table move, follow the previous iteration's principal variation
+    if (hashmove == 0 && ctx->pvply == d && d < ctx->depth - 1) {
+        hashmove = ctx->prevpv[d];
+    }
+    if (!usable(pos, p, hashmove)) {
+        hashmove = 0;
+    }
+
+    // The table move is searched before the others are even generated, so
+    // that when it cuts off, generating them is saved altogether
+    ScoredMove *list = ctx->frames[d].list;
+    int n = 0, generated = 0;
+    Move *line = ctx->frames[d].line;
+    Move best = 0;
+    int bestscore = -MAXEVAL - 1;
+    int tried = 0;
+    for (int i = 0; ; i++) {
+        Move m;
+        if (i == 0 && hashmove != 0) {
+            m = hashmove;
+        } else {
+            if (!generated) {
+                n = generate(ctx, d, hashmove);
+                generated = 1;
+            }
+            int k = hashmove != 0 ? i - 1 : i;
+            if (k >= n) {
+                break;
+            }
+            m = list[k].move;
+        }
+
+        int onpv = ctx->pvply == d && m == ctx->prevpv[d];
+        if (onpv) {
+            ctx->pvply = d + 1;
+        }
+        line[d] = m;
+        bb_apply(pos, m);
+        int s;
+        if (tried > 0 && search_algorithm == SEARCH_PVS) {
+            // After the first move, it is enough to show that a move is no
+            // better than the best so far, which a null window does cheaply;
+            // only a move that turns out better needs its true score
+            s = -alphabeta(ctx, d + 1, 1 - p, line, -alpha - 1, -alpha);
+            if (s > alpha && s < beta && !stopped(ctx)) {
+                long before = bb_stats.nodes;
+                s = -alphabeta(ctx, d + 1, 1 - p, line, -beta, -alpha);
+                ctx->researches++;
+                ctx->research_nodes += bb_stats.nodes - before;
+            }
+        } else {
+            s = -alphabeta(ctx, d + 1, 1 - p, line, -beta, -alpha);
+        }
+        bb_undo(pos, m);
+        if (onpv) {
+            ctx->pvply = d;
+        }
+        tried++;
+        // A stopped search has nothing worth keeping, except at the root,
+        // where each move that was searched to the end has a true score.
+        // The previous best move is searched first, so whatever is best
+        // so far is at least as good as it at the new depth.
+        if (stopped(ctx)) {
+            return d == 0 && best != 0 ? bestscore : 0;
+        }
+
+        if (s > bestscore
+            || (s == bestscore && randomized && !ctx->helper && (rand() & 0x100))) {
+            bestscore = s;
+            best = m;
+            memcpy(pvar + d, line + d, (ctx->depth - d) * sizeof(Move));
+            if (d == 0) {
+                ctx->rootmove = m;
+            }
+        }
+        if (bestscore > alpha) {
+            alpha = bestscore;
+        }
+        if (alpha >= beta) {
+            record_cutoff(ctx, d, p, m, remaining, tried == 1);
+            break;
+        }
+    }
+    if (tried == 0) {
+        return score;
+    }
+
+    int bound = bestscore <= alpha0 ? TT_UPPER : bestscore >= beta ? TT_LOWER : TT_EXACT;
+    tt_store(pos->key, best, bestscore, remaining, bound);
+    return bestscore;
+}
+
+// Make sure a context's arena has room for a search to the given depth.
+// This is the only place the search allocates memory.
+static int arena_init(SearchContext *ctx, int plies) {
+    if (ctx->plies >= plies) {
+        return 0;
+    }
+    PlyFrame *frames = calloc(plies + 1, sizeof(PlyFrame));
+    Move *triangle = calloc((size_t)(plies + 1) * (plies + 1), sizeof(Move));
+    Move *rootpv = calloc(plies + 1, sizeof(Move));
+    if (frames == NULL || triangle == NULL || rootpv == NULL) {
+        free(frames);
+        free(triangle);
+        free(rootpv);
+        return -1;
+    }
+    free(ctx->frames);
+    free(ctx->triangle);
+    free(ctx->rootpv);
+    for (int d = 0; d <= plies; d++) {
+        frames[d].line = triangle + (size_t)d * (plies + 1);
+    }
+    ctx->frames = frames;
+    ctx->triangle = triangle;
+    ctx->rootpv = rootpv;
+    ctx->plies = plies;
+    return 0;
+}
+
+// Helper thread: search the same root as the main thread, deepening until
+// told to stop.  Its results reach the main thread only through the table.
+static void *helper(void *arg) {
+    SearchContext *ctx = arg;
+    bb_stats = (BBStats){ 0 };
+    tt_reset_stats();
+    for (; ctx->depth <= max_depth && !stopped(ctx); ctx->depth++) {
+        alphabeta(ctx, 0, ctx->pos.tomove, ctx->rootpv, -MAXEVAL, MAXEVAL);
+    }
+    ctx->nodes = bb_stats.nodes;
+    return NULL;
+}
+
+// Stop and wait for the helper threads
+static void stop_threads(void) {
+    atomic_store(&stop_helpers, 1);
+    for (int i = 0; i < nhelpers; i++) {
+        pthread_join(helper_tid[i], NULL);
+        helper_nodes += helper_ctx[i].nodes;
+    }
+    nhelpers = 0;
+}
+
+// Start helper threads on the position in main_ctx.  Half of them look one
+// ply deeper than the main thread, so that the threads spread out over the
+// tree instead of all following the same path.
+static void start_helpers(void) {
+    sigset_t all, old;
+    // Signals must go to the main thread, which owns the protocol
+    sigfillset(&all);
+    pthread_sigmask(SIG_BLOCK, &all, &old);
+    atomic_store(&stop_helpers, 0);
+    for (int i = 0; i < search_threads - 1; i++) {
+        SearchContext *ctx = &helper_ctx[i];
+        bb_copybd(&main_ctx.pos, &ctx->pos);
+        ctx->depth = main_ctx.depth + (i & 1 ? 0 : 1);
+        if (ctx->depth > max_depth) {
+            ctx->depth = max_depth;
+        }
+        if (arena_init(ctx, max_depth) == -1) {
+            warn("No memory for search thread %d", i + 1);
+            break;
+        }
+        ctx->helper = 1;
+        ctx->nodes = 0;
+        ctx->pvply = -1;
+        if (pthread_create(&helper_tid[i], NULL, helper, ctx) != 0) {
+            warn("Could not start search thread %d", i + 1);
+            break;
+        }
+        nhelpers++;
+    }
+    pthread_sigmask(SIG_SETMASK, &old, NULL);
+}
+
+// Add the calling thread's counters into the library's statistics
+static void fold_stats(void) {
+    nodes += bb_stats.nodes;
+    stepgens += bb_stats.stepgens;
+    steptot += bb_stats.steptot;
+    jumpgens += bb_stats.jumpgens;
+    jumptot += bb_stats.jumptot;
+}
+
+int search(Board *bp, Player p, Move *pvar, int alpha, int beta)
+{
+    helper_nodes = 0;
+
+    // The search runs on its own bitboard copy of the position, so an
+    // interrupted search leaves bp untouched
+    if (bb_from_board(bp, &main_ctx.pos) == -1) {
+        // Should not happen; fall back to the library search
+        warn("Could not read board, searching with bestmove");
+        return -bestmove(bp, p, 0, pvar, alpha, beta);
+    }
+    if (depth < 1 || depth > MAXDEPTH || arena_init(&main_ctx, depth > max_depth ? depth : max_depth) == -1) {
+        warn("Cannot search to depth %d", depth);
+        search_status = SEARCH_ABORTED;
+        return 0;
+    }
+    main_ctx.depth = depth;
+    main_ctx.helper = 0;
+    main_ctx.aborted = 0;
+    main_ctx.rootmove = 0;
+    main_ctx.cutoffs = main_ctx.firstcutoffs = 0;
+    main_ctx.researches = main_ctx.research_nodes = 0;
+    // Fall back on the previous iteration's line wherever the table has lost it
+    memcpy(main_ctx.prevpv, pvar, depth * sizeof(Move));
+    memcpy(main_ctx.rootpv, pvar, depth * sizeof(Move));
+    main_ctx.pvply = 0;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    bb_stats = (BBStats){ 0 };
+    if (search_threads > 1 && depth > 1) {
+        start_helpers();
+    }
+    int score = alphabeta(&main_ctx, 0, p, main_ctx.rootpv, alpha, beta);
+    stop_threads();
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    search_ms = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_nsec - start.tv_nsec) / 1000000;
+    search_nodes = bb_stats.nodes;
+    if (!main_ctx.aborted) {
+        search_status = SEARCH_COMPLETE;
+    } else if (main_ctx.rootmove != 0 && score > alpha) {
+        search_status = SEARCH_PARTIAL;
+    } else {
+        // Nothing searched, or nothing but upper bounds from a narrow window
+        search_status = SEARCH_ABORTED;
+    }
+    if (search_status != SEARCH_ABORTED) {
+        memcpy(pvar, main_ctx.rootpv, depth * sizeof(Move));
+    }
+
+    fold_stats();
+    return score;
+}
+
+int search_replies(Board *bp, int d, Move *replies, int *scores, int max)
+{
+    Bitboard root;
+    if (bb_from_board(bp, &root) == -1 || d < 1 || d > MAXDEPTH
+        || arena_init(&main_ctx, d > max_depth ? d : max_depth) == -1) {
+        search_status = SEARCH_ABORTED;
+        return 0;
+    }
+    Player p = root.tomove;
+    Move *moves = main_ctx.frames[0].moves;
+    ScoredMove *list = main_ctx.frames[0].list;
+    int n = bb_moves(&root, moves);
+
+    main_ctx.depth = d;
+    main_ctx.helper = 0;
+    main_ctx.aborted = 0;
+    main_ctx.pvply = -1;
+    bb_stats = (BBStats){ 0 };
+    // Each reply gets a full-window search of its own, so that all the
+    // scores are exact and can be compared
+    for (int i = 0; i < n; i++) {
+        bb_copybd(&root, &main_ctx.pos);
+        bb_apply(&main_ctx.pos, moves[i]);
+        main_ctx.frames[0].line[0] = moves[i];
+        list[i].move = moves[i];
+        list[i].score = -alphabeta(&main_ctx, 1, 1 - p, main_ctx.frames[0].line,
+                                   -MAXEVAL, MAXEVAL);
+        if (stopped(&main_ctx)) {
+            fold_stats();
+            search_status = SEARCH_ABORTED;
+            return 0;
+        }
+    }
+    qsort(list, n, sizeof(ScoredMove), compare_scored);
+    fold_stats();
+
+    int k = n < max ? n : max;
+    for (int i = 0; i < k; i++) {
+        replies[i] = list[i].move;
+        if (scores != NULL) {
+            scores[i] = list[i].score;
+        }
+    }
+    search_status = SEARCH_COMPLETE;
+    return k;
+}
+
+void search_set_deadline(long ms)
+{
+    if (ms <= 0) {
+        has_deadline = 0;
+        return;
+    }
+    clock_gettime(CLOCK_MONOTONIC, &deadline);
+    deadline.tv_sec += ms / 1000;
+    deadline.tv_nsec += (ms % 1000) * 1000000;
+    if (deadline.tv_nsec >= 1000000000) {
+        deadline.tv_sec++;
+        deadline.tv_nsec -= 1000000000;
+    }
+    has_deadline = 1;
+}
+
+void search_print_pvar(Board *bp, Move *pvar, int d)
+{
+    Bitboard pos;
+    if (bb_from_board(bp, &pos) == -1) {
+        return;
+    }
+    Player p = pos.tomove;
+    for (int i = 0; i < d; i++) {
+        // Null moves only pad out the line once the game is over
+        if (SQ_FROM(pvar[i]) == SQ_TO(pvar[i])) {
+            break;
+        }
+        if (i > 0) {
+            fprintf(stderr, " ");
+        }
+        bb_print_move(&pos, pvar[i], stderr);
+        bb_apply(&pos, pvar[i]);
+    }
+    fprintf(stderr, " (%d)", bb_eval(&pos, p));
+}
+
+void search_print_stats(void)
+{
+    fprintf(stderr, "Cutoffs: %ld, on first move: %ld (%ld%%)\n", main_ctx.cutoffs,
+            main_ctx.firstcutoffs,
+            main_ctx.cutoffs > 0 ? 100 * main_ctx.firstcutoffs / main_ctx.cutoffs : 0);
+    if (search_algorithm == SEARCH_PVS) {
+        fprintf(stderr, "PVS re-searches: %ld, nodes: %ld\n", main_ctx.researches,
+                main_ctx.research_nodes);
+    }
+    fprintf(stderr, "Threads: %d, helper nodes: %ld, %ld ms\n",
+            search_threads, helper_nodes, search_ms);
+}
+
+void search_cutoffs(long *cutoffs, long *first)
+{
+    *cutoffs = main_ctx.cutoffs;
+    *first = main_ctx.firstcutoffs;
+}
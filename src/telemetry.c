@@ -0,0 +1,96 @@
+/*
+ * Search telemetry
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ccheck.h"
+#include "search.h"
+#include "telemetry.h"
+#include "debug.h"
+
+#define RECORD_MAX 8192                   // Longest record, with its newline
+
+int telemetry_fd = -1;
+
+// The last iteration of the engine's own search, for the branching factor
+static int last_move, last_depth;
+static long last_nodes;
+
+static const char *status_names[] = { "complete", "partial", "aborted" };
+static const char *budget_names[] = { "none", "start", "stop", "ponder" };
+
+int telemetry_open(const char *path)
+{
+    int fd = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd == -1) {
+        return -1;
+    }
+    if (telemetry_fd != -1) {
+        close(telemetry_fd);
+    }
+    telemetry_fd = fd;
+    return 0;
+}
+
+void telemetry_iteration(Board *bp, const Iteration *it, const Move *pv)
+{
+    char record[RECORD_MAX];
+    FILE *s = fmemopen(record, sizeof(record), "w");
+    if (s == NULL) {
+        return;
+    }
+    int move = move_number(bp);
+    Player p = player_to_move(bp);
+    fprintf(s, "{\"pid\":%d,\"move\":%d,\"player\":\"%s\",\"depth\":%d,\"status\":\"%s\"",
+            (int)getpid(), move, p == X ? "white" : "black", it->depth,
+            it->status == -1 ? "declined" : status_names[it->status]);
+    fprintf(s, ",\"budget\":\"%s\",\"elapsed_ms\":%ld,\"predicted_ms\":%ld"
+            ",\"target_ms\":%ld,\"limit_ms\":%ld",
+            budget_names[it->budget], it->elapsed_ms, it->predicted_ms, it->target_ms, it->limit_ms);
+
+    if (it->status != -1) {
+        long expanded = it->stepgens > 0 ? it->stepgens : 1;
+        fprintf(s, ",\"score\":%d,\"nodes\":%ld,\"us\":%ld,\"nps\":%ld", it->score, it->nodes,
+                it->us, it->us > 0 ? (long)(it->nodes * 1000000.0 / it->us) : 0);
+        fprintf(s, ",\"stepgens\":%ld,\"steps\":%ld,\"jumpgens\":%ld,\"jumps\":%ld,\"branching\":%.2f",
+                it->stepgens, it->steptot, it->jumpgens, it->jumptot,
+                (double)(it->steptot + it->jumptot) / expanded);
+        // Only successive depths of the same move's search compare
+        int own = it->budget != BUDGET_PONDER && it->status == SEARCH_COMPLETE;
+        if (own && move == last_move && it->depth == last_depth + 1 && last_nodes > 0) {
+            fprintf(s, ",\"ebf\":%.2f", (double)it->nodes / last_nodes);
+        } else {
+            fprintf(s, ",\"ebf\":null");
+        }
+        if (own) {
+            last_move = move;
+            last_depth = it->depth;
+            last_nodes = it->nodes;
+        }
+        fprintf(s, ",\"cutoffs\":%ld,\"first_cutoffs\":%ld,\"researches\":%d",
+                it->cutoffs, it->firstcutoffs, it->researches);
+
+        // The line stops where the game does, or where the record is full
+        fprintf(s, ",\"pv\":[");
+        int n = it->status == SEARCH_COMPLETE ? it->depth : it->status == SEARCH_PARTIAL;
+        Board *board = copybd(bp, newbd());
+        for (int i = 0; i < n && (pv[i] & 0xffff) != 0 && ftell(s) < RECORD_MAX - 64; i++) {
+            fprintf(s, i == 0 ? "\"" : ",\"");
+            print_move(board, pv[i], s);
+            fprintf(s, "\"");
+            apply(board, pv[i]);
+        }
+        free(board);
+        fprintf(s, "]");
+    }
+    fprintf(s, "}\n");
+    long len = ftell(s);
+    fclose(s);
+    if (write(telemetry_fd, record, len) != len) {
+        debug("Could not write telemetry record");
+    }
+}
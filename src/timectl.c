@@ -0,0 +1,132 @@
+/*
+ * Engine time control
+ */
+
+#include <stdio.h>
+#include <time.h>
+
+#include "ccheck.h"
+#include "search.h"
+#include "timectl.h"
+#include "debug.h"
+
+#define TC_SPREAD 4                       // Moves over which time saved or overspent is evened out
+#define TC_RATE_MIN_MS 10                 // Shortest search whose node rate is trusted
+
+long avgtime_ms = 0;
+
+static long used_ms;                      // Time charged to the engine's moves so far
+static int moves_made;                    // Number of those moves
+static long move_start;                   // When the current move was requested
+static long target;                       // Time the current move should take
+static long hard;                         // Time the current move may not exceed
+static double est_nodes[MAXDEPTH + 1];    // Average node count of searches to each depth
+static double rate;                       // Average positions evaluated per millisecond
+
+long clock_ms(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000L + now.tv_nsec / 1000000;
+}
+
+long clock_us(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return now.tv_sec * 1000000L + now.tv_nsec / 1000;
+}
+
+void tc_start_move(void)
+{
+    move_start = clock_ms();
+    // The average, plus a share of the time saved on earlier moves (or less
+    // a share of the time overspent), but never less than a quarter of it
+    long saved = avgtime_ms * moves_made - used_ms;
+    target = avgtime_ms + saved / TC_SPREAD;
+    if (target < avgtime_ms / 4) {
+        target = avgtime_ms / 4;
+    }
+    hard = target * TC_HARD_FACTOR;
+    debug("Move %d: target %ld ms, limit %ld ms, saved %ld ms", moves_made + 1, target, hard, saved);
+}
+
+void tc_end_move(void)
+{
+    used_ms += clock_ms() - move_start;
+    moves_made++;
+}
+
+void tc_record(int d, long nodes, long ms)
+{
+    if (d < 1 || d > MAXDEPTH) {
+        return;
+    }
+    // Averaged, since a search that repeats one just done (as after
+    // pondering) is mostly answered from the transposition table
+    est_nodes[d] = est_nodes[d] == 0 ? nodes : (est_nodes[d] + nodes) / 2;
+    // Very short searches are mostly overhead and timer granularity
+    if (ms >= TC_RATE_MIN_MS) {
+        double r = (double)nodes / ms;
+        rate = rate == 0 ? r : (3 * rate + r) / 4;
+    }
+}
+
+long tc_predict(int d)
+{
+    if (d < 2 || d > MAXDEPTH || est_nodes[d - 1] == 0 || rate == 0) {
+        return 0;
+    }
+    // Alpha/beta searches alternate between cheap and expensive depths, so
+    // the growth from d-1 to d is best estimated by the last step of the
+    // same kind, from d-3 to d-2
+    double ebf;
+    if (d >= 4 && est_nodes[d - 2] > 0 && est_nodes[d - 3] > 0) {
+        ebf = est_nodes[d - 2] / est_nodes[d - 3];
+    } else if (d >= 3 && est_nodes[d - 2] > 0) {
+        ebf = est_nodes[d - 1] / est_nodes[d - 2];
+    } else {
+        ebf = TC_DEFAULT_EBF;
+    }
+    if (ebf < 1) {
+        ebf = 1;
+    }
+    // Searches to this depth have been seen to cost more than that
+    double n = est_nodes[d - 1] * ebf;
+    if (est_nodes[d] > n) {
+        n = est_nodes[d];
+    }
+    return (long)(n / rate);
+}
+
+int tc_start_iteration(int d)
+{
+    return clock_ms() - move_start + tc_predict(d) <= target;
+}
+
+long tc_remaining(void)
+{
+    long left = hard - (clock_ms() - move_start);
+    return left > 0 ? left : 1;
+}
+
+void tc_best_changed(void)
+{
+    target += target * TC_UNSTABLE_EXTRA / 100;
+    if (target > hard) {
+        target = hard;
+    }
+}
+
+void tc_budget(long *elapsed, long *target_ms, long *limit)
+{
+    *elapsed = clock_ms() - move_start;
+    *target_ms = target;
+    *limit = hard;
+}
+
+void tc_print(void)
+{
+    fprintf(stderr, "Time: %ld ms (target %ld ms, limit %ld ms)\n",
+            clock_ms() - move_start, target, hard);
+}
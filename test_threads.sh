@@ -0,0 +1,23 @@
+#!/bin/bash
+# Time-to-depth of the engine's search with 1, 2, 4, 8 and 16 threads.
+# The engine ponders the opening position for a while at each thread count;
+# the time reported for each depth is that of the last search to that depth,
+# followed by the total time to get there.
+
+SECONDS_PER_RUN=${1:-20}
+
+echo "=== Search Thread Scaling (time to depth in ms) ==="
+echo ""
+
+for t in 1 2 4 8 16; do
+    echo "Threads: $t"
+    (sleep $SECONDS_PER_RUN; echo "") | timeout $((SECONDS_PER_RUN + 5)) ./bin/ccheck -w -d -a 1000 -T $t -v 2>&1 |
+        tr '\n' ' ' | grep -oE "Searching depth [0-9]+\.\.\.Nodes[^T]*Time[^T]*TM: [0-9/]+ [^S]*Threads: [0-9]+, helper nodes: [0-9]+, [0-9]+ ms" |
+        sed -E 's/Searching depth ([0-9]+)\.\.\.Nodes: ([0-9]+).*helper nodes: ([0-9]+), ([0-9]+) ms/\1 \2 \3 \4/' |
+        awk '{ ms[$1] = $4; n[$1] = $2 + $3 } END { for (d in ms) print d, ms[d], n[d] }' |
+        sort -n |
+        awk '{ total += $2; printf "  depth %2d: %8d ms (%8d ms total) %10d nodes\n", $1, $2, total, $3 }'
+    echo ""
+done
+
+echo "=== Scaling Test Complete ==="
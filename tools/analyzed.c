@@ -0,0 +1,689 @@
+/*
+ * Position analysis daemon
+ *
+ * Usage: analyzed [-j workers] [engine options] socket
+ *   -j <num>     number of positions to analyze at once (default: one per core)
+ *
+ * The engine options are those of ccheck (e.g. "-H 64 -T 2 -S pvs"); -D sets
+ * the depth searched when a request gives no limit of its own, and the
+ * deepest a request without a time or node limit may ask for.
+ *
+ * Listens on a Unix domain socket for requests to analyze positions, each a
+ * line of words:
+ *
+ *   [depth <ply>] [time <ms>] [nodes <num>] [position <pos>] [moves <move> ...]
+ *
+ * The position is the one reached by the moves from the given position (in
+ * the text form of position.h), or from the start if there is none; the
+ * moves are given as in a transcript (e.g. "white:C2-C3").  The search
+ * deepens until it reaches the depth, or until the time or node limit runs
+ * out, whichever is first.  Each request is answered with a line
+ *
+ *   bestmove <move> score <n> depth <ply> nodes <num> time <ms> pv <move> ...
+ *
+ * where the score is from the view of the player to move, or with a line
+ * "error <message>".  A connection may send any number of requests without
+ * waiting for the answers, which come back in the order of the requests.
+ *
+ * The searches are done by a pool of worker processes, started once, each
+ * with its own transposition table, which is kept from one request to the
+ * next.  Requests wait for a free worker in the order they arrive, from
+ * whichever connection.  A worker still searching for a connection that
+ * has closed is killed and replaced.  The daemon itself only parses requests
+ * and passes them on, from a single event loop.  SIGINT or SIGTERM shuts it
+ * down.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "ccheck.h"
+#include "engine.h"
+#include "bitboard.h"
+#include "search.h"
+#include "hash.h"
+#include "timectl.h"
+#include "position.h"
+
+#define MAX_HISTORY 1024                  // Moves leading to a position
+#define MAX_LINE 32768                    // Longest request, with its newline
+#define MAX_ANSWER 8192                   // Longest answer, with its newline
+#define MAX_EVENTS 16                     // Events taken from epoll_wait at a time
+
+// What each descriptor watched by the event loop is
+#define CONN_LISTEN 1                     // The listening socket
+#define CONN_SIGNAL 2                     // The signalfd
+#define CONN_CLIENT 3                     // A connection from a client
+#define CONN_WORKER 4                     // The socket to a worker
+
+// A position to analyze and the limits on the search, sent to a worker
+typedef struct job {
+    int depth;                            // Deepest search
+    long ms;                              // Time limit, or 0 for none
+    long nodes;                           // Node limit, or 0 for none
+    Position start;                       // Position the moves are played from
+    int nmoves;
+    Move moves[MAX_HISTORY];              // Moves from start; only nmoves are sent
+} Job;
+
+struct client;
+
+typedef struct request {
+    struct client *client;                // Who asked
+    Job job;
+    int running;                          // A worker has it
+    char *answer;                         // Once there is one
+    struct request *next;                 // The client's next request
+    struct request *queued;               // Next request waiting for a worker
+} Request;
+
+typedef struct client {
+    int kind;                             // CONN_CLIENT
+    int fd;
+    char in[MAX_LINE];                    // Input not yet taken as lines
+    size_t inlen;
+    char *out;                            // Answers not yet written
+    size_t outlen, outcap;
+    int eof;                              // No more requests will come
+    int skipping;                         // Skipping the rest of a request too long to take
+    int dead;                             // Closed, to be freed after the events at hand
+    struct client *next_dead;
+    Request *head, *tail;                 // Requests not yet answered, oldest first
+} Client;
+
+typedef struct worker {
+    int kind;                             // CONN_WORKER
+    int fd;
+    pid_t pid;
+    Request *busy;                        // The request being worked on, if any
+} Worker;
+
+static int epfd, listen_fd, signal_fd;
+static int max_fd;                        // Highest descriptor the daemon has had open
+static Worker *workers;
+static int nworkers;
+static Request *queue_head, *queue_tail;  // Requests waiting for a worker
+static Client *dead_clients;             // Closed clients not yet freed
+static sigset_t old_mask;
+static int listen_kind = CONN_LISTEN, signal_kind = CONN_SIGNAL;
+
+/*
+ * The workers
+ */
+
+static long node_limit, nodes_before;     // Node limit of the search, and nodes before this depth
+
+static int out_of_nodes(void) {
+    return nodes_before + bb_stats.nodes >= node_limit;
+}
+
+// Analyze a position, and format the answer
+static void analyze(const Job *job, char *answer) {
+    Board *board = decode_bd(&job->start);
+    for (int i = 0; i < job->nmoves; i++) {
+        apply(board, job->moves[i]);
+    }
+    Player p = player_to_move(board);
+
+    // Results kept from one request to the next are looked up, but give way
+    tt_new_search();
+    Move pv[MAXDEPTH + 1] = { 0 }, best[MAXDEPTH + 1] = { 0 };
+    int completed = 0, score = 0;
+    long nodes = 0;
+    long start = clock_ms();
+    for (depth = 1; depth <= job->depth; depth++) {
+        // Depth 1 always runs to completion, so that there is a move
+        if (depth == 2) {
+            if (job->ms > 0) {
+                long left = job->ms - (clock_ms() - start);
+                if (left <= 0) {
+                    break;
+                }
+                search_set_deadline(left);
+            }
+            if (job->nodes > 0) {
+                node_limit = job->nodes;
+                search_interrupt = out_of_nodes;
+            }
+        }
+        nodes_before = nodes;
+        int result = search(board, p, pv, -MAXEVAL, MAXEVAL);
+        nodes += search_nodes;
+        if (search_status != SEARCH_COMPLETE) {
+            break;
+        }
+        completed = depth;
+        score = result;
+        memcpy(best, pv, depth * sizeof(Move));
+        if (result == WINEVAL || result == -WINEVAL) {
+            break;
+        }
+    }
+    search_set_deadline(0);
+    search_interrupt = NULL;
+    long ms = clock_ms() - start;
+
+    FILE *s = fmemopen(answer, MAX_ANSWER, "w");
+    fprintf(s, "bestmove ");
+    print_move(board, best[0], s);
+    fprintf(s, " score %d depth %d nodes %ld time %ld pv", score, completed, nodes, ms);
+    // The line stops where the game does; a move of the line that no longer
+    // fits is left out
+    for (int i = 0; i < completed && (best[i] & 0xffff) != 0; i++) {
+        if (ftell(s) > MAX_ANSWER - 64) {
+            break;
+        }
+        fprintf(s, " ");
+        print_move(board, best[i], s);
+        apply(board, best[i]);
+    }
+    fprintf(s, "\n");
+    fclose(s);
+    free(board);
+}
+
+// Serve jobs until the daemon goes away
+static void work(int fd) {
+    if (tt_init() == -1) {
+        fprintf(stderr, "Worker could not allocate transposition table\n");
+        _exit(EXIT_FAILURE);
+    }
+    Job job;
+    char answer[MAX_ANSWER];
+    ssize_t n;
+    while ((n = recv(fd, &job, sizeof(job), 0)) > 0) {
+        analyze(&job, answer);
+        if (send(fd, answer, strlen(answer), MSG_NOSIGNAL) == -1) {
+            break;
+        }
+    }
+    _exit(EXIT_SUCCESS);
+}
+
+static int start_worker(Worker *w) {
+    int sv[2];
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, sv) == -1) {
+        return -1;
+    }
+    max_fd = sv[0] > max_fd ? sv[0] : max_fd;
+    max_fd = sv[1] > max_fd ? sv[1] : max_fd;
+    w->pid = fork();
+    if (w->pid == -1) {
+        close(sv[0]);
+        close(sv[1]);
+        return -1;
+    }
+    if (w->pid == 0) {
+        // The daemon takes the signals; a worker just goes when it does
+        signal(SIGINT, SIG_IGN);
+        sigprocmask(SIG_SETMASK, &old_mask, NULL);
+        // Only the daemon may hold the clients' and the other workers'
+        // sockets, so that each sees the other end go
+        for (int fd = STDERR_FILENO + 1; fd <= max_fd; fd++) {
+            if (fd != sv[1]) {
+                close(fd);
+            }
+        }
+        work(sv[1]);
+    }
+    close(sv[1]);
+    w->kind = CONN_WORKER;
+    w->fd = sv[0];
+    w->busy = NULL;
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = w };
+    return epoll_ctl(epfd, EPOLL_CTL_ADD, w->fd, &ev);
+}
+
+/*
+ * The daemon
+ */
+
+// Parse a request; on error, return a message
+static const char *parse_request(char *line, Job *job) {
+    memset(job, 0, offsetof(Job, moves));
+    job->depth = -1;
+    Bitboard bb;
+    bb_newbd(&bb);
+    bb_encode(&bb, &job->start);
+    char *save, *end;
+    char *w = strtok_r(line, " \t\r\n", &save);
+    for (; w != NULL && strcmp(w, "moves") != 0; w = strtok_r(NULL, " \t\r\n", &save)) {
+        char *arg = strtok_r(NULL, " \t\r\n", &save);
+        if (strcmp(w, "position") == 0) {
+            // A board can only be set up with the pieces a game starts with
+            Bitboard full;
+            bb_newbd(&full);
+            if (arg == NULL || position_parse(arg, &job->start) == -1
+                || bb_decode(&job->start, &bb) == -1
+                || count_squares(bb.pieces[X]) != count_squares(full.pieces[X])
+                || count_squares(bb.pieces[O]) != count_squares(full.pieces[O])) {
+                return "bad position";
+            }
+            continue;
+        }
+        long v = arg != NULL ? strtol(arg, &end, 10) : 0;
+        if (arg == NULL || *end != '\0' || v <= 0) {
+            return "limits must be positive numbers";
+        }
+        if (strcmp(w, "depth") == 0) {
+            job->depth = v < MAXDEPTH ? v : MAXDEPTH;
+        } else if (strcmp(w, "time") == 0) {
+            job->ms = v;
+        } else if (strcmp(w, "nodes") == 0) {
+            job->nodes = v;
+        } else {
+            return "unknown limit";
+        }
+    }
+    if (job->depth == -1) {
+        // With only a time or node limit, deepen as far as it allows
+        job->depth = job->ms > 0 || job->nodes > 0 ? MAXDEPTH : max_depth;
+    } else if (job->ms == 0 && job->nodes == 0 && job->depth > max_depth) {
+        // Nothing else would stop a search this deep in reasonable time
+        job->depth = max_depth;
+    }
+    while (w != NULL && (w = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        if (job->nmoves == MAX_HISTORY) {
+            return "too many moves";
+        }
+        Move m = bb_parse_move(&bb, w);
+        if (m == 0 || !bb_legal(&bb, m)) {
+            return "illegal move";
+        }
+        bb_apply(&bb, m);
+        job->moves[job->nmoves++] = m;
+    }
+    if (bb_game_over(&bb) != 0) {
+        return "game is over";
+    }
+    return NULL;
+}
+
+// Hand waiting requests to idle workers
+static void dispatch(void) {
+    for (int i = 0; i < nworkers && queue_head != NULL; i++) {
+        Worker *w = &workers[i];
+        if (w->busy != NULL || w->pid <= 0) {
+            continue;
+        }
+        Request *r = queue_head;
+        queue_head = r->queued;
+        if (queue_head == NULL) {
+            queue_tail = NULL;
+        }
+        size_t len = offsetof(Job, moves) + r->job.nmoves * sizeof(Move);
+        if (send(w->fd, &r->job, len, MSG_NOSIGNAL) == -1) {
+            // The worker has died; SIGCHLD will replace it
+            r->queued = queue_head;
+            queue_head = r;
+            if (queue_tail == NULL) {
+                queue_tail = r;
+            }
+            w->pid = -w->pid;
+            continue;
+        }
+        r->running = 1;
+        w->busy = r;
+    }
+}
+
+// Stop the worker on a request nobody is waiting for any more.  It is
+// replaced, as if it had died, once SIGCHLD comes.
+static void cancel(Request *r) {
+    for (int i = 0; i < nworkers; i++) {
+        Worker *w = &workers[i];
+        if (w->busy == r && w->pid > 0) {
+            kill(w->pid, SIGKILL);
+            w->pid = -w->pid;
+            w->busy = NULL;
+        }
+    }
+}
+
+// Close a client; it is freed once the events at hand have been handled
+static void drop_client(Client *c) {
+    for (Request *r = c->head, *next; r != NULL; r = next) {
+        next = r->next;
+        if (r->running) {
+            cancel(r);
+        }
+        if (r->answer == NULL) {
+            Request **pp = &queue_head;
+            queue_tail = NULL;
+            for (Request *q = queue_head; q != NULL; q = q->queued) {
+                if (q == r) {
+                    *pp = q->queued;
+                } else {
+                    pp = &q->queued;
+                    queue_tail = q;
+                }
+            }
+        }
+        free(r->answer);
+        free(r);
+    }
+    close(c->fd);
+    c->dead = 1;
+    c->next_dead = dead_clients;
+    dead_clients = c;
+}
+
+// Write out the answers that are due, in order; return -1 if the client is gone
+static int flush_client(Client *c) {
+    while (c->head != NULL && c->head->answer != NULL) {
+        Request *r = c->head;
+        size_t len = strlen(r->answer);
+        if (c->outlen + len > c->outcap) {
+            size_t cap = c->outcap ? c->outcap : MAX_ANSWER;
+            while (cap < c->outlen + len) {
+                cap *= 2;
+            }
+            char *out = realloc(c->out, cap);
+            if (out == NULL) {
+                return -1;
+            }
+            c->out = out;
+            c->outcap = cap;
+        }
+        memcpy(c->out + c->outlen, r->answer, len);
+        c->outlen += len;
+        c->head = r->next;
+        if (c->head == NULL) {
+            c->tail = NULL;
+        }
+        free(r->answer);
+        free(r);
+    }
+    while (c->outlen > 0) {
+        ssize_t n = send(c->fd, c->out, c->outlen, MSG_NOSIGNAL);
+        if (n == -1 && errno == EAGAIN) {
+            break;
+        }
+        if (n <= 0) {
+            return -1;
+        }
+        memmove(c->out, c->out + n, c->outlen - n);
+        c->outlen -= n;
+    }
+    if (c->eof && c->head == NULL && c->outlen == 0) {
+        return -1;
+    }
+    // Wait for room for the rest, and stop reading once there is no more
+    struct epoll_event ev = { .events = (c->eof ? 0 : EPOLLIN) | (c->outlen > 0 ? EPOLLOUT : 0), .data.ptr = c };
+    return epoll_ctl(epfd, EPOLL_CTL_MOD, c->fd, &ev);
+}
+
+// Take a request, or answer one too long to take (line NULL)
+static void add_request(Client *c, char *line) {
+    Request *r = calloc(1, sizeof(Request));
+    if (r == NULL) {
+        return;
+    }
+    r->client = c;
+    const char *err = line != NULL ? parse_request(line, &r->job) : "request too long";
+    if (err != NULL) {
+        char answer[64];
+        snprintf(answer, sizeof(answer), "error %s\n", err);
+        if ((r->answer = strdup(answer)) == NULL) {
+            free(r);
+            return;
+        }
+    } else if (queue_tail != NULL) {
+        queue_tail->queued = r;
+        queue_tail = r;
+    } else {
+        queue_head = queue_tail = r;
+    }
+    if (c->tail != NULL) {
+        c->tail->next = r;
+    } else {
+        c->head = r;
+    }
+    c->tail = r;
+}
+
+// Take the requests a client has sent; return -1 if it is gone
+static int read_client(Client *c) {
+    while (1) {
+        ssize_t n = read(c->fd, c->in + c->inlen, sizeof(c->in) - c->inlen);
+        if (n == -1 && errno == EAGAIN) {
+            break;
+        }
+        if (n <= 0) {
+            c->eof = 1;
+            break;
+        }
+        c->inlen += n;
+        char *line = c->in, *nl;
+        while ((nl = memchr(line, '\n', c->in + c->inlen - line)) != NULL) {
+            *nl = '\0';
+            if (c->skipping) {
+                c->skipping = 0;
+                add_request(c, NULL);
+            } else if (strspn(line, " \t\r") != strlen(line)) {
+                add_request(c, line);
+            }
+            line = nl + 1;
+        }
+        c->inlen -= line - c->in;
+        memmove(c->in, line, c->inlen);
+        if (c->inlen == sizeof(c->in)) {
+            c->inlen = 0;
+            c->skipping = 1;
+        }
+    }
+    dispatch();
+    return flush_client(c);
+}
+
+// Give a request that was being worked on its answer, and pass on the
+// client's answers if they are now due
+static void finish(Request *r, const char *answer) {
+    Client *c = r->client;
+    r->running = 0;
+    r->answer = strdup(answer);
+    if (r->answer == NULL || flush_client(c) == -1) {
+        drop_client(c);
+    }
+}
+
+// Take a worker's answer to its request
+static void read_worker(Worker *w) {
+    char answer[MAX_ANSWER + 1];
+    // An event can come for a worker just replaced, which has nothing to say
+    ssize_t n = recv(w->fd, answer, MAX_ANSWER, MSG_DONTWAIT);
+    if (n <= 0) {
+        // Or it has died, and SIGCHLD will replace it
+        return;
+    }
+    answer[n] = '\0';
+    if (w->busy != NULL) {
+        finish(w->busy, answer);
+        w->busy = NULL;
+    }
+    dispatch();
+}
+
+// Replace the workers that have died, failing their requests
+static int reap_workers(void) {
+    pid_t pid;
+    while ((pid = waitpid(-1, NULL, WNOHANG)) > 0) {
+        for (int i = 0; i < nworkers; i++) {
+            Worker *w = &workers[i];
+            if (w->pid != pid && w->pid != -pid) {
+                continue;
+            }
+            fprintf(stderr, "Worker %d died\n", pid);
+            close(w->fd);
+            Request *r = w->busy;
+            if (start_worker(w) == -1) {
+                return -1;
+            }
+            if (r != NULL) {
+                finish(r, "error worker died\n");
+            }
+        }
+    }
+    dispatch();
+    return 0;
+}
+
+// Listen on a socket, taking it over from a daemon that is no longer there
+static int listen_on(const char *path) {
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        errno = ENAMETOOLONG;
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+        int probe = errno == EADDRINUSE ? socket(AF_UNIX, SOCK_STREAM, 0) : -1;
+        if (probe == -1 || connect(probe, (struct sockaddr *)&addr, sizeof(addr)) == 0
+            || errno != ECONNREFUSED || unlink(path) == -1
+            || bind(fd, (struct sockaddr *)&addr, sizeof(addr)) == -1) {
+            if (probe != -1) {
+                close(probe);
+            }
+            errno = EADDRINUSE;
+            close(fd);
+            return -1;
+        }
+        close(probe);
+    }
+    if (listen(fd, SOMAXCONN) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int main(int argc, char *argv[])
+{
+    nworkers = sysconf(_SC_NPROCESSORS_ONLN);
+    int option;
+    while ((option = getopt(argc, argv, "j:" ENGINE_OPTIONS)) != -1) {
+        if (option == 'j') {
+            nworkers = atoi(optarg);
+        } else if (option == '?' || engine_option(option, optarg) == -1) {
+            optind = argc;
+            break;
+        }
+    }
+    if (optind != argc - 1) {
+        fprintf(stderr, "Usage: %s [-j workers] [engine options] socket\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (nworkers < 1) {
+        nworkers = 1;
+    }
+    const char *path = argv[optind];
+
+    // Signals are taken from a signalfd by the event loop
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &mask, &old_mask);
+    signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    listen_fd = listen_on(path);
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (signal_fd == -1 || listen_fd == -1 || epfd == -1) {
+        perror(listen_fd == -1 ? path : "analyzed");
+        exit(EXIT_FAILURE);
+    }
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = &listen_kind };
+    epoll_ctl(epfd, EPOLL_CTL_ADD, listen_fd, &ev);
+    ev.data.ptr = &signal_kind;
+    epoll_ctl(epfd, EPOLL_CTL_ADD, signal_fd, &ev);
+
+    workers = calloc(nworkers, sizeof(Worker));
+    for (int i = 0; i < nworkers; i++) {
+        if (workers == NULL || start_worker(&workers[i]) == -1) {
+            perror("Could not start worker");
+            unlink(path);
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    int done = 0;
+    while (!done) {
+        struct epoll_event events[MAX_EVENTS];
+        int n = epoll_wait(epfd, events, MAX_EVENTS, -1);
+        if (n == -1 && errno != EINTR) {
+            perror("epoll_wait");
+            break;
+        }
+        for (int i = 0; i < n; i++) {
+            int kind = *(int *)events[i].data.ptr;
+            if (kind == CONN_LISTEN) {
+                int fd;
+                while ((fd = accept(listen_fd, NULL, NULL)) != -1) {
+                    fcntl(fd, F_SETFL, O_NONBLOCK);
+                    max_fd = fd > max_fd ? fd : max_fd;
+                    Client *c = calloc(1, sizeof(Client));
+                    struct epoll_event cev = { .events = EPOLLIN, .data.ptr = c };
+                    if (c == NULL || epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &cev) == -1) {
+                        free(c);
+                        close(fd);
+                        continue;
+                    }
+                    c->kind = CONN_CLIENT;
+                    c->fd = fd;
+                }
+            } else if (kind == CONN_SIGNAL) {
+                struct signalfd_siginfo si;
+                while (read(signal_fd, &si, sizeof(si)) == sizeof(si)) {
+                    if (si.ssi_signo == SIGCHLD) {
+                        if (reap_workers() == -1) {
+                            perror("Could not restart worker");
+                            done = 1;
+                        }
+                    } else {
+                        done = 1;
+                    }
+                }
+            } else if (kind == CONN_CLIENT) {
+                // A client that has hung up altogether cannot be answered
+                Client *c = events[i].data.ptr;
+                uint32_t what = events[i].events;
+                if (!c->dead && ((what & (EPOLLHUP | EPOLLERR))
+                                 || (what & EPOLLIN ? read_client(c) : flush_client(c)) == -1)) {
+                    drop_client(c);
+                }
+            } else {
+                read_worker(events[i].data.ptr);
+            }
+        }
+        while (dead_clients != NULL) {
+            Client *c = dead_clients;
+            dead_clients = c->next_dead;
+            free(c->out);
+            free(c);
+        }
+    }
+
+    // The workers go with the daemon, whatever they are doing
+    for (int i = 0; i < nworkers; i++) {
+        if (workers[i].pid != 0) {
+            kill(workers[i].pid < 0 ? -workers[i].pid : workers[i].pid, SIGKILL);
+        }
+    }
+    unlink(path);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,163 @@
+/*
+ * Opening book builder
+ *
+ * Usage: bookbuild [-g games] [-d depth] [-p plies] [-s seed] -o book [transcript ...]
+ *   -g <num>     number of self-play games to add (default 0)
+ *   -d <num>     depth in ply of the self-play searches (default 4)
+ *   -p <num>     number of moves from the start of each game to keep (default 16)
+ *   -s <num>     random seed for self-play (default 1)
+ *   -o <file>    book file to write
+ *
+ * Each transcript is a game score as written by ccheck -o (or read by -i):
+ * one move per line, optionally preceded by a move number.  Scores with an
+ * illegal move, and of games started from a position (-p), are reported
+ * and left out.  Every position
+ * reached in the first moves of a game, transcript or self-play, is recorded
+ * with the move played from it; moves played more often weigh more.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ccheck.h"
+#include "search.h"
+#include "book.h"
+
+static BookEntry *list;
+static size_t nlist, maxlist;
+
+// Record the move played from a position
+static void add(const Bitboard *bp, Move m) {
+    if (nlist == maxlist) {
+        maxlist = maxlist ? 2 * maxlist : 1024;
+        list = realloc(list, maxlist * sizeof(BookEntry));
+        if (list == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    list[nlist++] = (BookEntry){ bp->key, m, 1 };
+}
+
+// Add the opening of a game score.  A score with an illegal move, or of a
+// game that started from a position of its own, is reported and left out.
+static int add_transcript(const char *path, int plies) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    Bitboard bb;
+    bb_newbd(&bb);
+    size_t first = nlist;
+    char token[128];
+    for (int ply = 0; ply < plies && !bb_game_over(&bb) && fscanf(f, "%127s", token) == 1; ) {
+        if (ply == 0 && strcmp(token, "position") == 0) {
+            fprintf(stderr, "%s: game starts from a position of its own, skipped\n", path);
+            break;
+        }
+        // Skip the move numbers ("12." or "12. ...") in front of the moves
+        if (strchr(token, ':') == NULL) {
+            continue;
+        }
+        Move m = bb_parse_move(&bb, token);
+        if (m == 0 || !bb_legal(&bb, m)) {
+            fprintf(stderr, "%s: illegal move %s, skipped\n", path, token);
+            nlist = first;
+            break;
+        }
+        add(&bb, m);
+        bb_apply(&bb, m);
+        ply++;
+    }
+    fclose(f);
+    return 0;
+}
+
+// Add the opening of a game the engine plays against itself
+static void add_selfplay(int plies, int d) {
+    Board *board = newbd();
+    Bitboard bb;
+    Move pv[MAXDEPTH + 1];
+    if (bb_from_board(board, &bb) == -1) {
+        fprintf(stderr, "Could not read board\n");
+        exit(EXIT_FAILURE);
+    }
+    for (int ply = 0; ply < plies && !bb_game_over(&bb); ply++) {
+        memset(pv, 0, sizeof(pv));
+        depth = d;
+        search(board, player_to_move(board), pv, -MAXEVAL, MAXEVAL);
+        add(&bb, pv[0]);
+        apply(board, pv[0]);
+        bb_apply(&bb, pv[0]);
+    }
+    free(board);
+}
+
+int main(int argc, char *argv[])
+{
+    int games = 0, d = 4, plies = 16;
+    char *output = NULL;
+    int option;
+
+    srandom(1);
+    while ((option = getopt(argc, argv, "g:d:p:s:o:")) != -1) {
+        switch (option) {
+            case 'g':
+                games = atoi(optarg);
+                break;
+            case 'd':
+                d = atoi(optarg);
+                break;
+            case 'p':
+                plies = atoi(optarg);
+                break;
+            case 's':
+                srandom(atoi(optarg));
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                output = NULL;
+                optind = argc + 1;
+                break;
+        }
+    }
+    if (output == NULL || optind > argc || d < 1 || d > MAXDEPTH) {
+        fprintf(stderr, "Usage: %s [-g games] [-d depth] [-p plies] [-s seed] -o book [transcript ...]\n",
+                argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    max_depth = d;
+    if (tt_init() == -1) {
+        fprintf(stderr, "Could not allocate transposition table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (add_transcript(argv[i], plies) == -1) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    // Randomized play makes each game take its own line
+    randomized = 1;
+    for (int i = 0; i < games; i++) {
+        tt_new_search();
+        add_selfplay(plies, d);
+        fprintf(stderr, "\rGame %d of %d", i + 1, games);
+    }
+    if (games > 0) {
+        fprintf(stderr, "\n");
+    }
+
+    long n = book_write(output, list, nlist);
+    if (n == -1) {
+        perror(output);
+        exit(EXIT_FAILURE);
+    }
+    fprintf(stderr, "%zu moves, %ld book entries\n", nlist, n);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,220 @@
+/*
+ * Engine handoff latency benchmark
+ *
+ * Usage: handoff [-n moves] [-s seed]
+ *   -n <num>     number of moves to time in each mode (default 500)
+ *   -s <num>     random seed for the engine's opponent (default 1)
+ *
+ * Times the exchanges between the game and its engine, with the engine run
+ * as ccheck runs it by default (a process of its own, talked to through
+ * pipes and woken by SIGHUP) and as it runs it with -I (a thread, talked to
+ * through channels).  The engine plays white at depth 1, against random
+ * moves for black, and is given time to finish thinking before each
+ * exchange, so that what is measured is the cost of the handoff itself:
+ * for ">", from sending the opponent's move to receiving the
+ * acknowledgement, and for "<", from asking for a move to receiving it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+#include "ccheck.h"
+#include "engine.h"
+#include "search.h"
+#include "bitboard.h"
+
+#define SETTLE_US 5000                    // Time the engine is given to go idle
+
+#define MODE_PROCESS 0
+#define MODE_THREAD 1
+
+// An engine in either mode
+typedef struct handle {
+    int mode;
+    pid_t pid;                            // MODE_PROCESS: the engine process and its pipes
+    FILE *in, *out;
+    Channel commands, replies;            // MODE_THREAD: the engine thread and its channels
+    pthread_t tid;
+} Handle;
+
+static long now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000L + ts.tv_nsec;
+}
+
+static int start(Handle *h, Board *board) {
+    if (h->mode == MODE_THREAD) {
+        channel_init(&h->commands);
+        channel_init(&h->replies);
+        return engine_start_thread(board, &h->commands, &h->replies, &h->tid);
+    }
+    // Anything still buffered would be written again by the engine process
+    fflush(stdout);
+    int to_engine[2], from_engine[2];
+    if (pipe(to_engine) == -1 || pipe(from_engine) == -1 || (h->pid = fork()) == -1) {
+        return -1;
+    }
+    if (h->pid == 0) {
+        dup2(to_engine[0], STDIN_FILENO);
+        dup2(from_engine[1], STDOUT_FILENO);
+        close(to_engine[0]);
+        close(to_engine[1]);
+        close(from_engine[0]);
+        close(from_engine[1]);
+        engine(board);
+        _exit(EXIT_SUCCESS);
+    }
+    close(to_engine[0]);
+    close(from_engine[1]);
+    h->out = fdopen(to_engine[1], "w");
+    h->in = fdopen(from_engine[0], "r");
+    char line[256];
+    return fgets(line, sizeof(line), h->in) != NULL ? 0 : -1;
+}
+
+static void stop(Handle *h) {
+    if (h->mode == MODE_THREAD) {
+        channel_send(&h->commands, (Message){ MSG_QUIT, 0 });
+        pthread_join(h->tid, NULL);
+        return;
+    }
+    fclose(h->out);
+    fclose(h->in);
+    kill(h->pid, SIGKILL);
+    waitpid(h->pid, NULL, 0);
+}
+
+// Ask for the engine's move
+static Move request(Handle *h, Board *board) {
+    if (h->mode == MODE_THREAD) {
+        channel_send(&h->commands, (Message){ MSG_REQUEST, 0 });
+        return channel_receive(&h->replies).move;
+    }
+    fprintf(h->out, "<\n");
+    fflush(h->out);
+    kill(h->pid, SIGHUP);
+    return read_move_from_pipe(h->in, board);
+}
+
+// Tell the engine the opponent's move
+static void tell(Handle *h, Board *board, Move m) {
+    if (h->mode == MODE_THREAD) {
+        channel_send(&h->commands, (Message){ MSG_OPPONENT, m });
+        channel_receive(&h->replies);
+        return;
+    }
+    fprintf(h->out, ">");
+    print_move(board, m, h->out);
+    fprintf(h->out, "\n");
+    fflush(h->out);
+    kill(h->pid, SIGHUP);
+    char ack[256];
+    if (fgets(ack, sizeof(ack), h->in) == NULL) {
+        fprintf(stderr, "Engine died\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+static int compare_long(const void *a, const void *b) {
+    long x = *(const long *)a, y = *(const long *)b;
+    return (x > y) - (x < y);
+}
+
+static void report(const char *mode, const char *what, long *ns, int n) {
+    qsort(ns, n, sizeof(long), compare_long);
+    double sum = 0;
+    for (int i = 0; i < n; i++) {
+        sum += ns[i];
+    }
+    printf("%-8s %-2s %6d %10.1f %10.1f %10.1f\n", mode, what, n,
+           sum / n / 1000, ns[n / 2] / 1000.0, ns[n * 99 / 100] / 1000.0);
+}
+
+// Time n exchanges of each kind in one mode
+static void measure(int mode, int n, unsigned seed) {
+    long *requests = calloc(n, sizeof(long)), *tells = calloc(n, sizeof(long));
+    int nrequests = 0, ntells = 0;
+    Move list[MAXMOVES];
+
+    while (nrequests < n || ntells < n) {
+        // One game per engine; a new one once it is over
+        Board *board = newbd();
+        Bitboard bb;
+        bb_newbd(&bb);
+        Handle h = { .mode = mode };
+        if (start(&h, board) == -1) {
+            fprintf(stderr, "Could not start engine\n");
+            exit(EXIT_FAILURE);
+        }
+        while (!game_over(board) && (nrequests < n || ntells < n)) {
+            usleep(SETTLE_US);
+            long t = now_ns();
+            Move m;
+            if (player_to_move(board) == X) {
+                m = request(&h, board);
+                if (m == 0) {
+                    fprintf(stderr, "Engine died\n");
+                    exit(EXIT_FAILURE);
+                }
+                if (nrequests < n) {
+                    requests[nrequests++] = now_ns() - t;
+                }
+            } else {
+                int k = bb_moves(&bb, list);
+                m = list[rand_r(&seed) % k];
+                t = now_ns();
+                tell(&h, board, m);
+                if (ntells < n) {
+                    tells[ntells++] = now_ns() - t;
+                }
+            }
+            apply(board, m);
+            bb_apply(&bb, m);
+        }
+        stop(&h);
+        free(board);
+    }
+    report(mode == MODE_THREAD ? "thread" : "process", "<", requests, n);
+    report(mode == MODE_THREAD ? "thread" : "process", ">", tells, n);
+    free(requests);
+    free(tells);
+}
+
+int main(int argc, char *argv[])
+{
+    int n = 500;
+    unsigned seed = 1;
+    int option;
+    while ((option = getopt(argc, argv, "n:s:")) != -1) {
+        switch (option) {
+            case 'n':
+                n = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-n moves] [-s seed]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (n < 1) {
+        n = 1;
+    }
+
+    // Depth 1 and no pondering, so that the engine is idle between exchanges
+    max_depth = 1;
+    ponder_enabled = 0;
+    signal(SIGPIPE, SIG_IGN);
+
+    printf("%-8s %-2s %6s %10s %10s %10s\n", "mode", "", "count", "mean us", "median us", "p99 us");
+    measure(MODE_PROCESS, n, seed);
+    measure(MODE_THREAD, n, seed);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,203 @@
+/*
+ * Game log converter
+ *
+ * Usage: logconv [-g game] [-s] log
+ *        logconv -a log transcript ...
+ *   -g <num>     print only game <num> of the log (counting from 1)
+ *   -s           print what the engine's search found with each move
+ *   -a <file>    append each transcript to the log as a game
+ *
+ * The first form prints the games of a binary game log (as written by
+ * ccheck -L) as transcripts, in the format written by ccheck -o, with a
+ * blank line after each game.  With -s, each move is followed by a comment
+ * giving its time and, for the engine's moves, the depth, score and node
+ * count of its search; ccheck -i skips these.  The second form turns
+ * transcripts into games of a log, which then have no times or search
+ * results.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+#include <unistd.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+#include "gamelog.h"
+#include "position.h"
+
+// Print one game as a transcript
+static void print_game(const LogGame *game, const LogRecord *records, int stats) {
+    Bitboard bb;
+    static const Position none;
+    if (memcmp(&game->start, &none, sizeof(none)) == 0 || bb_decode(&game->start, &bb) == -1) {
+        bb_newbd(&bb);
+    } else {
+        // Written as ccheck -o writes a game begun with -p
+        printf("position ");
+        position_print(&game->start, stdout);
+        printf("\n");
+    }
+    // A game that black begins is numbered as if white had moved first
+    uint32_t first = bb.tomove == O;
+    for (uint32_t i = first; i < first + game->nmoves; i++) {
+        const LogRecord *r = &records[i - first];
+        // Numbered as by ccheck: white's moves "n.", black's "n. ..."
+        if (((r->move >> 16) & 1) == X) {
+            printf("%" PRIu32 ". ", i / 2 + 1);
+        } else {
+            printf("%" PRIu32 ". ... ", (i + 1) / 2);
+        }
+        if (!bb_legal(&bb, r->move)) {
+            printf("?\n");
+            fprintf(stderr, "Illegal move %" PRIu32 " in game\n", i - first + 1);
+            return;
+        }
+        bb_print_move(&bb, r->move, stdout);
+        if (stats && (r->flags & LOG_ENGINE)) {
+            printf("  # %" PRIu32 " ms, depth %u, score %" PRId32 ", %" PRIu64 " nodes",
+                   r->ms, r->depth, r->score, r->nodes);
+        } else if (stats && !(r->flags & LOG_HISTORY)) {
+            printf("  # %" PRIu32 " ms", r->ms);
+        }
+        printf("\n");
+        bb_apply(&bb, r->move);
+    }
+    printf("\n");
+}
+
+// Append a transcript to a log as a game; one with an illegal move is
+// reported and not logged
+static int append_transcript(GameLog *log, const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    // A game begun with ccheck -p names its starting position first
+    Bitboard bb;
+    Position start;
+    char token[128];
+    int from_position = fscanf(f, "%127s", token) == 1 && strcmp(token, "position") == 0;
+    if (from_position) {
+        if (fscanf(f, "%127s", token) != 1 || position_parse(token, &start) == -1) {
+            fprintf(stderr, "Bad position in %s\n", path);
+            fclose(f);
+            return -1;
+        }
+        bb_decode(&start, &bb);
+    } else {
+        rewind(f);
+        bb_newbd(&bb);
+    }
+    // The whole transcript is checked before any of it is logged, so that a
+    // bad one leaves nothing behind
+    Move *moves = NULL;
+    size_t nmoves = 0, maxmoves = 0;
+    int ret = 0;
+    while (fscanf(f, "%127s", token) == 1) {
+        // Skip move numbers and comments, which have no ':'
+        if (strchr(token, ':') == NULL) {
+            continue;
+        }
+        Move m = bb_parse_move(&bb, token);
+        if (m == 0 || !bb_legal(&bb, m)) {
+            fprintf(stderr, "Illegal move in %s: %s\n", path, token);
+            ret = -1;
+            break;
+        }
+        if (nmoves == maxmoves) {
+            maxmoves = maxmoves ? 2 * maxmoves : 256;
+            Move *more = realloc(moves, maxmoves * sizeof(Move));
+            if (more == NULL) {
+                perror("realloc");
+                ret = -1;
+                break;
+            }
+            moves = more;
+        }
+        moves[nmoves++] = m;
+        bb_apply(&bb, m);
+    }
+    fclose(f);
+
+    if (ret == 0) {
+        ret = gamelog_begin(log, -1, from_position ? &start : NULL);
+    }
+    for (size_t i = 0; ret == 0 && i < nmoves; i++) {
+        LogRecord rec = { .move = moves[i] };
+        ret = gamelog_move(log, &rec);
+    }
+    free(moves);
+    int winner = bb_game_over(&bb);
+    if (ret == 0 && winner != 0) {
+        ret = gamelog_result(log, winner);
+    }
+    return ret;
+}
+
+int main(int argc, char *argv[])
+{
+    char *append = NULL;
+    long game = 0;
+    int stats = 0;
+    int option;
+    while ((option = getopt(argc, argv, "g:sa:")) != -1) {
+        switch (option) {
+            case 'g':
+                game = atol(optarg);
+                break;
+            case 's':
+                stats = 1;
+                break;
+            case 'a':
+                append = optarg;
+                break;
+            default:
+                optind = argc + 1;
+                break;
+        }
+    }
+    if (optind > argc || (append == NULL && optind != argc - 1) || game < 0) {
+        fprintf(stderr, "Usage: %s [-g game] [-s] log\n       %s -a log transcript ...\n", argv[0], argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    if (append != NULL) {
+        GameLog *log = gamelog_open(append);
+        if (log == NULL) {
+            fprintf(stderr, "Could not open game log %s\n", append);
+            exit(EXIT_FAILURE);
+        }
+        int ret = 0;
+        for (int i = optind; i < argc && ret == 0; i++) {
+            ret = append_transcript(log, argv[i]);
+        }
+        if (gamelog_close(log) == -1 || ret == -1) {
+            exit(EXIT_FAILURE);
+        }
+        return EXIT_SUCCESS;
+    }
+
+    LogView view;
+    if (gamelog_map(argv[optind], &view) == -1) {
+        fprintf(stderr, "Could not read game log %s\n", argv[optind]);
+        exit(EXIT_FAILURE);
+    }
+    // The index leads straight to a single game
+    uint64_t first = game > 0 ? game - 1 : 0;
+    uint64_t last = game > 0 ? (uint64_t)game : view.ngames;
+    for (uint64_t i = first; i < last; i++) {
+        const LogRecord *records;
+        const LogGame *g = gamelog_game(&view, i, &records);
+        if (g == NULL) {
+            fprintf(stderr, "No game %" PRIu64 " in %s\n", i + 1, argv[optind]);
+            gamelog_unmap(&view);
+            exit(EXIT_FAILURE);
+        }
+        print_game(g, records, stats);
+    }
+    gamelog_unmap(&view);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,422 @@
+/*
+ * Evaluation network trainer
+ *
+ * Usage: nnuetrain [-g games] [-d depth] [-p plies] [-e epochs] [-l rate] [-s seed]
+ *                  [-w samples] [-N net] -o net [samples ...]
+ *   -g <num>     number of self-play games to take samples from (default 0)
+ *   -d <num>     depth in ply of the self-play searches (default 4)
+ *   -p <num>     number of random moves that open each game (default 8)
+ *   -e <num>     number of passes over the samples (default 30)
+ *   -l <num>     learning rate (default 0.002)
+ *   -s <num>     random seed (default 1)
+ *   -w <file>    append the samples taken from self-play to a file
+ *   -N <file>    start from a network file, which also plays the games
+ *   -o <file>    network file to write (see nnue.h)
+ *
+ * A sample is a position and its score for X, as found by a search of the
+ * given depth; the network learns how far that is from the handwritten
+ * evaluation, so as to see some of what the search sees.  In a self-play
+ * game the engine plays itself with randomized play, after the random
+ * opening moves, and each position it searches becomes a sample until the
+ * search sees the game won or lost, which ends it.  Sample files have one
+ * sample per line,
+ *
+ *   <position> <score>
+ *
+ * with the position in the text form of position.h; blank lines and lines
+ * starting with '#' are skipped, as are won or lost positions.  They are
+ * read as well as the samples of the games, so that samples taken once can
+ * be trained on many times.
+ *
+ * The network is trained in floating point by stochastic gradient descent
+ * on the squared error, with every tenth sample held out to check on how
+ * well it does on positions it has not seen.  The error on those, in
+ * evaluation units, is reported after each pass and, at the end, for the
+ * network as written, whose weights are rounded to integers.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <unistd.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+#include "search.h"
+#include "position.h"
+#include "nnue.h"
+
+#define MAX_PIECES 20                     // Pieces on the board
+#define MAX_PLIES 180                     // Moves after which an undecided self-play game is given up
+#define MAX_TARGET 8.0                    // Largest correction learned, in network output units
+#define MAX_WEIGHT 4.0                    // Largest first layer weight, so that sums fit in 16 bits
+#define MAX_LINE 256                      // Longest line of a sample file
+#define HOLDOUT 10                        // One sample in this many is held out
+
+typedef struct sample {
+    Position pos;
+    int tomove;
+    int nfeatures;
+    short features[MAX_PIECES];           // The features set, as in nnue.h
+    float target;                         // Correction to the score for X, in network output units
+} Sample;
+
+static Sample *samples;
+static size_t nsamples, maxsamples;
+
+// The network, in floating point, with weights and activations of 1.0 where
+// the quantized one has NNUE_QA and NNUE_QB
+static float w1[NNUE_FEATURES][NNUE_HIDDEN], b1[NNUE_HIDDEN];
+static float w2[NNUE_HIDDEN], b2[2];
+
+static double uniform(double lo, double hi) {
+    return lo + (hi - lo) * random() / RAND_MAX;
+}
+
+static float clampf(float x, float lo, float hi) {
+    return x < lo ? lo : x > hi ? hi : x;
+}
+
+// Record a position and its score for X
+static void add(const Bitboard *bb, int score) {
+    if (nsamples == maxsamples) {
+        maxsamples = maxsamples ? 2 * maxsamples : 4096;
+        samples = realloc(samples, maxsamples * sizeof(Sample));
+        if (samples == NULL) {
+            perror("realloc");
+            exit(EXIT_FAILURE);
+        }
+    }
+    Sample *s = &samples[nsamples++];
+    bb_encode(bb, &s->pos);
+    s->tomove = bb->tomove;
+    s->nfeatures = 0;
+    for (int p = 0; p < 2; p++) {
+        for (Bits b = bb->pieces[p]; b != 0; b &= b - 1) {
+            s->features[s->nfeatures++] = p * NSQUARES + first_square(b);
+        }
+    }
+    s->target = clampf((float)(score - bb->score) / NNUE_SCALE, -MAX_TARGET, MAX_TARGET);
+}
+
+// Take samples from a game the engine plays against itself
+static void add_selfplay(int d, int plies, FILE *out) {
+    Board *board = newbd();
+    Bitboard bb;
+    bb_newbd(&bb);
+    Move list[MAXMOVES], pv[MAXDEPTH + 1];
+    for (int ply = 0; ply < MAX_PLIES && bb_game_over(&bb) == 0; ply++) {
+        Move m;
+        if (ply < plies) {
+            int n = bb_moves(&bb, list);
+            m = list[random() % n];
+        } else {
+            Player p = player_to_move(board);
+            memset(pv, 0, sizeof(pv));
+            depth = d;
+            tt_new_search();
+            int score = search(board, p, pv, -MAXEVAL, MAXEVAL);
+            // Once the search sees the end, the rest of the game teaches nothing
+            if (score == WINEVAL || score == -WINEVAL) {
+                break;
+            }
+            if (p == O) {
+                score = -score;
+            }
+            add(&bb, score);
+            if (out != NULL) {
+                position_print(&samples[nsamples - 1].pos, out);
+                fprintf(out, " %d\n", score);
+            }
+            m = pv[0];
+        }
+        apply(board, m);
+        bb_apply(&bb, m);
+    }
+    free(board);
+}
+
+// Read the samples in a file
+static int add_file(const char *path) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[MAX_LINE], text[MAX_LINE];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        size_t skip = strspn(line, " \t\r\n");
+        if (line[skip] == '\0' || line[skip] == '#') {
+            continue;
+        }
+        Position pos;
+        Bitboard bb;
+        int score;
+        if (sscanf(line, "%255s %d", text, &score) != 2 || position_parse(text, &pos) == -1
+            || bb_decode(&pos, &bb) == -1 || count_squares(bb.pieces[X] | bb.pieces[O]) > MAX_PIECES) {
+            fprintf(stderr, "%s:%d: bad sample\n", path, lineno);
+            fclose(f);
+            return -1;
+        }
+        if (score != WINEVAL && score != -WINEVAL) {
+            add(&bb, score);
+        }
+    }
+    fclose(f);
+    return 0;
+}
+
+// Start from small random weights, with the hidden sums in the middle of
+// the range where they count
+static void init_network(void) {
+    for (int i = 0; i < NNUE_FEATURES; i++) {
+        for (int j = 0; j < NNUE_HIDDEN; j++) {
+            w1[i][j] = uniform(-0.05, 0.05);
+        }
+    }
+    for (int j = 0; j < NNUE_HIDDEN; j++) {
+        b1[j] = 0.5;
+        w2[j] = uniform(-0.05, 0.05);
+    }
+    b2[X] = b2[O] = 0;
+}
+
+// Start from a network file
+static void from_network(const Network *net) {
+    for (int i = 0; i < NNUE_FEATURES; i++) {
+        for (int j = 0; j < NNUE_HIDDEN; j++) {
+            w1[i][j] = (float)net->w1[i][j] / NNUE_QA;
+        }
+    }
+    for (int j = 0; j < NNUE_HIDDEN; j++) {
+        b1[j] = (float)net->b1[j] / NNUE_QA;
+        w2[j] = (float)net->w2[j] / NNUE_QB;
+    }
+    for (int p = 0; p < 2; p++) {
+        b2[p] = (float)net->b2[p] / (NNUE_QA * NNUE_QB);
+    }
+}
+
+static int16_t quantize(float x, int scale) {
+    long q = lroundf(x * scale);
+    return q < INT16_MIN ? INT16_MIN : q > INT16_MAX ? INT16_MAX : q;
+}
+
+static void to_network(Network *net) {
+    for (int i = 0; i < NNUE_FEATURES; i++) {
+        for (int j = 0; j < NNUE_HIDDEN; j++) {
+            net->w1[i][j] = quantize(w1[i][j], NNUE_QA);
+        }
+    }
+    for (int j = 0; j < NNUE_HIDDEN; j++) {
+        net->b1[j] = quantize(b1[j], NNUE_QA);
+        net->w2[j] = quantize(w2[j], NNUE_QB);
+    }
+    for (int p = 0; p < 2; p++) {
+        net->b2[p] = lroundf(b2[p] * NNUE_QA * NNUE_QB);
+    }
+}
+
+// The output for a sample, leaving the hidden sums in a
+static float forward(const Sample *s, float *a) {
+    memcpy(a, b1, sizeof(b1));
+    for (int i = 0; i < s->nfeatures; i++) {
+        for (int j = 0; j < NNUE_HIDDEN; j++) {
+            a[j] += w1[s->features[i]][j];
+        }
+    }
+    float y = b2[s->tomove];
+    for (int j = 0; j < NNUE_HIDDEN; j++) {
+        y += w2[j] * clampf(a[j], 0, 1);
+    }
+    return y;
+}
+
+// Move the weights against the gradient of the squared error on a sample
+static void step(const Sample *s, float rate) {
+    float a[NNUE_HIDDEN];
+    float g = rate * (forward(s, a) - s->target);
+    b2[s->tomove] -= g;
+    for (int j = 0; j < NNUE_HIDDEN; j++) {
+        float h = clampf(a[j], 0, 1);
+        // The sum only counts between the clamps
+        float gh = a[j] > 0 && a[j] < 1 ? g * w2[j] : 0;
+        w2[j] -= g * h;
+        if (gh == 0) {
+            continue;
+        }
+        b1[j] = clampf(b1[j] - gh, -MAX_WEIGHT, MAX_WEIGHT);
+        for (int i = 0; i < s->nfeatures; i++) {
+            float *w = &w1[s->features[i]][j];
+            *w = clampf(*w - gh, -MAX_WEIGHT, MAX_WEIGHT);
+        }
+    }
+}
+
+// Root mean square error, in evaluation units, over the samples trained on
+// (held 0) or held out (held 1)
+static double rms_error(int held) {
+    float a[NNUE_HIDDEN];
+    double sum = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < nsamples; i++) {
+        if ((i % HOLDOUT == 0) != held) {
+            continue;
+        }
+        double e = forward(&samples[i], a) - samples[i].target;
+        sum += e * e;
+        n++;
+    }
+    return n > 0 ? sqrt(sum / n) * NNUE_SCALE : 0;
+}
+
+// The same for the quantized network, worked out as bb_eval does
+static double rms_error_quantized(const Network *net) {
+    nnue_use(net);
+    double sum = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < nsamples; i += HOLDOUT) {
+        Bitboard bb;
+        bb_decode(&samples[i].pos, &bb);
+        double e = nnue_output(bb.acc, bb.tomove) - samples[i].target * NNUE_SCALE;
+        sum += e * e;
+        n++;
+    }
+    return n > 0 ? sqrt(sum / n) : 0;
+}
+
+static void train(int epochs, float rate) {
+    size_t *order = malloc(nsamples * sizeof(size_t));
+    size_t n = 0;
+    if (order == NULL) {
+        perror("malloc");
+        exit(EXIT_FAILURE);
+    }
+    for (size_t i = 0; i < nsamples; i++) {
+        if (i % HOLDOUT != 0) {
+            order[n++] = i;
+        }
+    }
+    for (int e = 0; e < epochs; e++) {
+        for (size_t i = n; i > 1; i--) {
+            size_t k = random() % i, t = order[i - 1];
+            order[i - 1] = order[k];
+            order[k] = t;
+        }
+        // Smaller steps as the weights settle
+        float r = rate / (1 + 4.0 * e / epochs);
+        for (size_t i = 0; i < n; i++) {
+            step(&samples[order[i]], r);
+        }
+        fprintf(stderr, "Pass %d of %d: error %.0f, held out %.0f\n", e + 1, epochs, rms_error(0),
+                rms_error(1));
+    }
+    free(order);
+}
+
+int main(int argc, char *argv[])
+{
+    int games = 0, d = 4, plies = 8, epochs = 30;
+    float rate = 0.002;
+    char *output = NULL, *samples_out = NULL, *start = NULL;
+    int option;
+
+    srandom(1);
+    while ((option = getopt(argc, argv, "g:d:p:e:l:s:w:N:o:")) != -1) {
+        switch (option) {
+            case 'g':
+                games = atoi(optarg);
+                break;
+            case 'd':
+                d = atoi(optarg);
+                break;
+            case 'p':
+                plies = atoi(optarg);
+                break;
+            case 'e':
+                epochs = atoi(optarg);
+                break;
+            case 'l':
+                rate = atof(optarg);
+                break;
+            case 's':
+                srandom(atoi(optarg));
+                break;
+            case 'w':
+                samples_out = optarg;
+                break;
+            case 'N':
+                start = optarg;
+                break;
+            case 'o':
+                output = optarg;
+                break;
+            default:
+                output = NULL;
+                optind = argc + 1;
+                break;
+        }
+    }
+    if (output == NULL || optind > argc || d < 1 || d > MAXDEPTH || plies < 0 || epochs < 0
+        || rate <= 0) {
+        fprintf(stderr, "Usage: %s [-g games] [-d depth] [-p plies] [-e epochs] [-l rate] [-s seed]\n"
+                "       [-w samples] [-N net] -o net [samples ...]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    if (start != NULL && nnue_load(start) == -1) {
+        fprintf(stderr, "Could not load network file %s\n", start);
+        exit(EXIT_FAILURE);
+    }
+    max_depth = d;
+    if (tt_init() == -1) {
+        fprintf(stderr, "Could not allocate transposition table\n");
+        exit(EXIT_FAILURE);
+    }
+
+    for (int i = optind; i < argc; i++) {
+        if (add_file(argv[i]) == -1) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    FILE *out = NULL;
+    if (samples_out != NULL && (out = fopen(samples_out, "a")) == NULL) {
+        perror(samples_out);
+        exit(EXIT_FAILURE);
+    }
+    // Randomized play makes each game take its own line
+    randomized = 1;
+    for (int i = 0; i < games; i++) {
+        add_selfplay(d, plies, out);
+        fprintf(stderr, "\rGame %d of %d, %zu samples", i + 1, games, nsamples);
+    }
+    if (games > 0) {
+        fprintf(stderr, "\n");
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    if (nsamples == 0) {
+        fprintf(stderr, "No samples to train on\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (start != NULL) {
+        from_network(nnue_net);
+    } else {
+        init_network();
+    }
+    train(epochs, rate);
+
+    static Network net;
+    to_network(&net);
+    fprintf(stderr, "%zu samples, held out error %.0f as written (%s kernels)\n", nsamples,
+            rms_error_quantized(&net), nnue_kernel_name());
+    if (nnue_save(output, &net) == -1) {
+        perror(output);
+        exit(EXIT_FAILURE);
+    }
+    return EXIT_SUCCESS;
+}
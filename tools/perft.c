@@ -0,0 +1,336 @@
+/*
+ * Move generator benchmark and check
+ *
+ * Usage: perft [-d depth] [-j jobs] [-l] [-c] [-p pos] [-i file]
+ *   -d <num>     depth in ply to count to (default 4)
+ *   -j <num>     number of root moves to count at once (default 1)
+ *   -l           count with the library's generator (moves, apply and undo)
+ *                instead of the bitboard one (bb_moves, bb_apply and bb_undo)
+ *   -c           check the two generators against each other at every node
+ *   -p <pos>     count from a position, in the text form of position.h
+ *   -i <file>    count from the position reached by a saved game score
+ *
+ * Counts the positions reached by every sequence of moves of each length up
+ * to the depth, from the start of a game or the position given.  A position
+ * in which the game is over has no moves.  Each depth is reported on a line
+ *
+ *   depth <ply> nodes <num> time <us> nps <num>
+ *
+ * after which the count at the last depth is divided up by the root move
+ * that leads to each position, one line per root move:
+ *
+ *   <move> <num>
+ *
+ * Both generators make one move for each destination that a piece can
+ * reach, however many chains of hops lead there, so they give the same
+ * counts.  With -c, the moves of each position short of the last ply are
+ * compared, and the first position where the generators disagree is printed
+ * with the moves that only one of them makes.
+ *
+ * With -j, each root move is counted by a worker process of its own, up to
+ * the given number at once.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include "ccheck.h"
+#include "bitboard.h"
+#include "position.h"
+#include "timectl.h"
+
+#define GEN_BITBOARD 0                    // bb_moves, bb_apply, bb_undo
+#define GEN_LIBRARY 1                     // moves, apply, undo
+#define GEN_CHECK 2                       // Both, compared at each node
+
+// The library's move generator, which ccheck.h does not declare: moves()
+// leaves the moves of the side to move in resultlist, up to resultp
+extern Move resultlist[MAXMOVES];
+extern Move *resultp;
+void moves(Board *bp);
+void undo(Board *bp);
+
+// The count for a root move, as reported by a worker
+typedef struct result {
+    int index;
+    long nodes;
+} Result;
+
+static int generator = GEN_BITBOARD;
+
+static int compare_moves(const void *a, const void *b) {
+    Move x = *(const Move *)a, y = *(const Move *)b;
+    return x < y ? -1 : x > y;
+}
+
+// The library's moves of a position, taken out of resultlist before it is
+// reused
+static int library_moves(Board *board, Move *list) {
+    moves(board);
+    int n = resultp - resultlist;
+    memcpy(list, resultlist, n * sizeof(Move));
+    return n;
+}
+
+// Print the moves of a that are not in b, both sorted, by their end points
+static void report_difference(const char *which, const Move *a, int na, const Move *b, int nb) {
+    fprintf(stderr, "Only the %s generator makes", which);
+    for (int i = 0, j = 0; i < na; i++) {
+        while (j < nb && b[j] < a[i]) {
+            j++;
+        }
+        if (j == nb || b[j] != a[i]) {
+            fprintf(stderr, " %c%d-%c%d", 'A' + row_from(a[i]), col_from(a[i]) + 1,
+                    'A' + row_to(a[i]), col_to(a[i]) + 1);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+// Check that the generators make the same moves in a position, and exit if not
+static void check(Board *board, const Bitboard *bb, const Move *list, int n) {
+    Move lib[MAXMOVES], ours[MAXMOVES];
+    int nlib = library_moves(board, lib);
+    memcpy(ours, list, n * sizeof(Move));
+    qsort(lib, nlib, sizeof(Move), compare_moves);
+    qsort(ours, n, sizeof(Move), compare_moves);
+    if (nlib == n && memcmp(lib, ours, n * sizeof(Move)) == 0) {
+        return;
+    }
+    Position pos;
+    bb_encode(bb, &pos);
+    fprintf(stderr, "The generators disagree in position ");
+    position_print(&pos, stderr);
+    fprintf(stderr, " (%d moves from the library, %d from bitboards)\n", nlib, n);
+    report_difference("library", lib, nlib, ours, n);
+    report_difference("bitboard", ours, n, lib, nlib);
+    exit(EXIT_FAILURE);
+}
+
+// Generate the moves of a position, or none if the game is over
+static int generate(Board *board, const Bitboard *bb, Move *list) {
+    if (generator == GEN_LIBRARY) {
+        return game_over(board) ? 0 : library_moves(board, list);
+    }
+    if (bb_game_over(bb) != 0) {
+        return 0;
+    }
+    int n = bb_moves(bb, list);
+    if (generator == GEN_CHECK) {
+        check(board, bb, list, n);
+    }
+    return n;
+}
+
+static void make(Board *board, Bitboard *bb, Move m) {
+    if (generator != GEN_BITBOARD) {
+        apply(board, m);
+    }
+    if (generator != GEN_LIBRARY) {
+        bb_apply(bb, m);
+    }
+}
+
+static void unmake(Board *board, Bitboard *bb, Move m) {
+    if (generator != GEN_BITBOARD) {
+        undo(board);
+    }
+    if (generator != GEN_LIBRARY) {
+        bb_undo(bb, m);
+    }
+}
+
+// Count the positions d ply ahead
+static long perft(Board *board, Bitboard *bb, int d) {
+    Move list[MAXMOVES];
+    int n = generate(board, bb, list);
+    // The positions one ply ahead are just counted
+    if (d == 1) {
+        return n;
+    }
+    long nodes = 0;
+    for (int i = 0; i < n; i++) {
+        make(board, bb, list[i]);
+        nodes += perft(board, bb, d - 1);
+        unmake(board, bb, list[i]);
+    }
+    return nodes;
+}
+
+// Count the positions d ply ahead by each of the n root moves in list, jobs
+// of them at once
+static long divide(Board *board, Bitboard *bb, int d, int jobs, const Move *list, int n,
+                   long *counts) {
+    if (d == 1) {
+        for (int i = 0; i < n; i++) {
+            counts[i] = 1;
+        }
+        return n;
+    }
+    if (jobs == 1) {
+        long nodes = 0;
+        for (int i = 0; i < n; i++) {
+            make(board, bb, list[i]);
+            counts[i] = perft(board, bb, d - 1);
+            unmake(board, bb, list[i]);
+            nodes += counts[i];
+        }
+        return nodes;
+    }
+
+    // Workers report through one pipe; results are small enough to be written atomically
+    int results[2];
+    if (pipe(results) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(results[0], F_SETFL, O_NONBLOCK);
+    long nodes = 0;
+    int next = 0, running = 0, done = 0;
+    while (running > 0 || next < n) {
+        // Keep every job busy
+        while (running < jobs && next < n) {
+            pid_t pid = fork();
+            if (pid == -1) {
+                perror("fork");
+                exit(EXIT_FAILURE);
+            }
+            if (pid == 0) {
+                close(results[0]);
+                make(board, bb, list[next]);
+                Result r = { next, perft(board, bb, d - 1) };
+                write(results[1], &r, sizeof(r));
+                _exit(EXIT_SUCCESS);
+            }
+            running++;
+            next++;
+        }
+
+        int status;
+        if (wait(&status) == -1) {
+            break;
+        }
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            // A worker that found the generators disagreeing has said so
+            exit(EXIT_FAILURE);
+        }
+        Result r;
+        while (read(results[0], &r, sizeof(r)) == sizeof(r)) {
+            counts[r.index] = r.nodes;
+            nodes += r.nodes;
+            done++;
+        }
+    }
+    close(results[0]);
+    close(results[1]);
+    if (done != n) {
+        fprintf(stderr, "Lost the counts of %d root moves\n", n - done);
+        exit(EXIT_FAILURE);
+    }
+    return nodes;
+}
+
+// Play over a saved game score, as ccheck -i does
+static int read_game(const char *path, Board *board, Bitboard *bb) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char token[128];
+    while (fscanf(f, "%127s", token) == 1) {
+        // Skip the move numbers ("12." or "12. ...") in front of the moves
+        if (strchr(token, ':') == NULL) {
+            continue;
+        }
+        Move m = bb_parse_move(bb, token);
+        if (m == 0 || !bb_legal(bb, m)) {
+            fprintf(stderr, "Illegal move in %s: %s\n", path, token);
+            fclose(f);
+            return -1;
+        }
+        apply(board, m);
+        bb_apply(bb, m);
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    int d = 4, jobs = 1;
+    char *start_text = NULL, *init_file = NULL;
+    int option;
+    while ((option = getopt(argc, argv, "d:j:lcp:i:")) != -1) {
+        switch (option) {
+            case 'd':
+                d = atoi(optarg);
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                break;
+            case 'l':
+                generator = GEN_LIBRARY;
+                break;
+            case 'c':
+                generator = GEN_CHECK;
+                break;
+            case 'p':
+                start_text = optarg;
+                break;
+            case 'i':
+                init_file = optarg;
+                break;
+            default:
+                d = 0;
+                break;
+        }
+    }
+    if (optind != argc || d < 1 || jobs < 1) {
+        fprintf(stderr, "Usage: %s [-d depth] [-j jobs] [-l] [-c] [-p pos] [-i file]\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+
+    Board *board;
+    Position start;
+    if (start_text != NULL) {
+        if (position_parse(start_text, &start) == -1) {
+            fprintf(stderr, "Bad position: %s\n", start_text);
+            exit(EXIT_FAILURE);
+        }
+        board = decode_bd(&start);
+        if (board == NULL) {
+            fprintf(stderr, "A position must have ten pieces of each side\n");
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        board = newbd();
+    }
+    Bitboard bb;
+    if (bb_from_board(board, &bb) == -1 || (init_file != NULL && read_game(init_file, board, &bb) == -1)) {
+        exit(EXIT_FAILURE);
+    }
+
+    Move list[MAXMOVES];
+    long counts[MAXMOVES];
+    int n = generate(board, &bb, list);
+    for (int i = 1; i <= d; i++) {
+        long begin = clock_us();
+        long nodes = divide(board, &bb, i, jobs, list, n, counts);
+        long us = clock_us() - begin;
+        printf("depth %d nodes %ld time %ld nps %ld\n", i, nodes, us,
+               us > 0 ? (long)(nodes * 1000000.0 / us) : 0);
+        fflush(stdout);
+    }
+    for (int i = 0; i < n; i++) {
+        print_move(board, list[i], stdout);
+        printf(" %ld\n", counts[i]);
+    }
+    free(board);
+    exit(EXIT_SUCCESS);
+}
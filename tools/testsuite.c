@@ -0,0 +1,264 @@
+/*
+ * Position test-suite runner
+ *
+ * Usage: testsuite [-n nodes] [-t ms] [engine options] suite ...
+ *   -n <num>     stop each search after this many nodes
+ *   -t <num>     stop each search after this many milliseconds
+ *
+ * The engine options are those of ccheck (e.g. "-H 64 -S pvs"); -D sets the
+ * depth of each search, which is otherwise max_depth, or as deep as -n or -t
+ * allow if either is given.
+ *
+ * Each line of a suite gives a position, in the text form of position.h,
+ * followed by the moves that solve it and a name for it:
+ *
+ *   <position> bm <move> ... [id <name>]
+ *
+ * with the moves written as in a transcript (e.g. "white:C2-C3").  Blank
+ * lines and lines starting with '#' are skipped.  The positions are searched
+ * in order, each by iterative deepening from a cleared transposition table,
+ * so that with one search thread the node counts are the same from one run
+ * to the next and only the times vary.  Each is reported on a line
+ *
+ *   id <name> bestmove <move> solved <0|1> depth <ply> nodes <num>
+ *   time <us> nps <num> solvedepth <ply> solvenodes <num> solvetime <us>
+ *   ttd <us>,<us>,...
+ *
+ * (all on one line), where ttd is the time taken to complete each depth in
+ * turn, counting from the start of the search.  A position is solved if the
+ * best move of the last depth completed is one of those given; solvedepth,
+ * solvenodes and solvetime say when the search settled on it, and are "-"
+ * if it did not.  The runs end with a line
+ *
+ *   total positions <num> solved <num> nodes <num> time <us> nps <num>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ccheck.h"
+#include "engine.h"
+#include "bitboard.h"
+#include "search.h"
+#include "hash.h"
+#include "position.h"
+#include "timectl.h"
+
+#define MAX_SOLUTIONS 16                  // Solving moves of a position
+#define MAX_LINE 1024                     // Longest line of a suite
+
+// A position of a suite
+typedef struct test {
+    char id[64];
+    Position pos;
+    int nsolutions;
+    Move solutions[MAX_SOLUTIONS];
+} Test;
+
+static long node_limit, nodes_before;     // Node limit of the search, and nodes before this depth
+static long total_nodes, total_us;
+static int total_tests, total_solved;
+
+static int out_of_nodes(void) {
+    return nodes_before + bb_stats.nodes >= node_limit;
+}
+
+static long per_second(long nodes, long us) {
+    return us > 0 ? (long)(nodes * 1000000.0 / us) : 0;
+}
+
+// Parse a line of a suite; on error, return a message
+static const char *parse_test(char *line, int lineno, Test *t) {
+    memset(t, 0, sizeof(*t));
+    snprintf(t->id, sizeof(t->id), "%d", lineno);
+    char *save;
+    char *w = strtok_r(line, " \t\r\n", &save);
+    Bitboard bb;
+    if (position_parse(w, &t->pos) == -1 || bb_decode(&t->pos, &bb) == -1) {
+        return "bad position";
+    }
+    Board *board = decode_bd(&t->pos);
+    if (board == NULL) {
+        return "a position must have ten pieces of each side";
+    }
+    free(board);
+    if (bb_game_over(&bb) != 0) {
+        return "game is over";
+    }
+    int in_bm = 0;
+    while ((w = strtok_r(NULL, " \t\r\n", &save)) != NULL) {
+        if (strcmp(w, "bm") == 0) {
+            in_bm = 1;
+        } else if (strcmp(w, "id") == 0) {
+            in_bm = 0;
+            if ((w = strtok_r(NULL, " \t\r\n", &save)) == NULL) {
+                return "missing id";
+            }
+            snprintf(t->id, sizeof(t->id), "%s", w);
+        } else if (in_bm) {
+            Move m = bb_parse_move(&bb, w);
+            if (m == 0 || !bb_legal(&bb, m)) {
+                return "illegal move";
+            }
+            if (t->nsolutions == MAX_SOLUTIONS) {
+                return "too many moves";
+            }
+            t->solutions[t->nsolutions++] = m;
+        } else {
+            return "unknown keyword";
+        }
+    }
+    if (t->nsolutions == 0) {
+        return "no bm";
+    }
+    return NULL;
+}
+
+static int solves(const Test *t, Move m) {
+    for (int i = 0; i < t->nsolutions; i++) {
+        if (t->solutions[i] == m) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Search a position, and report how it went
+static void run(const Test *t, int max, long ms, long nodes_wanted) {
+    Board *board = decode_bd(&t->pos);
+    Player p = player_to_move(board);
+    if (tt_init() == -1) {
+        fprintf(stderr, "Could not allocate transposition table\n");
+        exit(EXIT_FAILURE);
+    }
+    tt_new_search();
+
+    Move pv[MAXDEPTH + 1] = { 0 }, best = 0;
+    long ttd[MAXDEPTH + 1];
+    int completed = 0, solve_depth = 0;
+    long nodes = 0, solve_nodes = 0, solve_us = 0;
+    long start = clock_us();
+    for (depth = 1; depth <= max; depth++) {
+        // Depth 1 always runs to completion, so that there is a move
+        if (depth == 2) {
+            if (ms > 0) {
+                long left = ms - (clock_us() - start) / 1000;
+                if (left <= 0) {
+                    break;
+                }
+                search_set_deadline(left);
+            }
+            if (nodes_wanted > 0) {
+                node_limit = nodes_wanted;
+                search_interrupt = out_of_nodes;
+            }
+        }
+        nodes_before = nodes;
+        int result = search(board, p, pv, -MAXEVAL, MAXEVAL);
+        nodes += search_nodes;
+        if (search_status != SEARCH_COMPLETE) {
+            break;
+        }
+        ttd[completed++] = clock_us() - start;
+        best = pv[0];
+        if (!solves(t, best)) {
+            solve_depth = 0;
+        } else if (solve_depth == 0) {
+            solve_depth = depth;
+            solve_nodes = nodes;
+            solve_us = ttd[completed - 1];
+        }
+        if (result == WINEVAL || result == -WINEVAL) {
+            break;
+        }
+    }
+    search_set_deadline(0);
+    search_interrupt = NULL;
+    long us = clock_us() - start;
+
+    printf("id %s bestmove ", t->id);
+    print_move(board, best, stdout);
+    printf(" solved %d depth %d nodes %ld time %ld nps %ld", solve_depth > 0, completed,
+           nodes, us, per_second(nodes, us));
+    if (solve_depth > 0) {
+        printf(" solvedepth %d solvenodes %ld solvetime %ld", solve_depth, solve_nodes, solve_us);
+    } else {
+        printf(" solvedepth - solvenodes - solvetime -");
+    }
+    printf(" ttd");
+    for (int i = 0; i < completed; i++) {
+        printf("%c%ld", i == 0 ? ' ' : ',', ttd[i]);
+    }
+    printf("\n");
+    fflush(stdout);
+    free(board);
+
+    total_tests++;
+    total_solved += solve_depth > 0;
+    total_nodes += nodes;
+    total_us += us;
+}
+
+// Run the positions of a suite in order
+static int run_suite(const char *path, int max, long ms, long nodes) {
+    FILE *f = fopen(path, "r");
+    if (f == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[MAX_LINE];
+    int lineno = 0;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        lineno++;
+        size_t skip = strspn(line, " \t\r\n");
+        if (line[skip] == '\0' || line[skip] == '#') {
+            continue;
+        }
+        Test t;
+        const char *err = parse_test(line, lineno, &t);
+        if (err != NULL) {
+            fprintf(stderr, "%s:%d: %s\n", path, lineno, err);
+            fclose(f);
+            return -1;
+        }
+        run(&t, max, ms, nodes);
+    }
+    fclose(f);
+    return 0;
+}
+
+int main(int argc, char *argv[])
+{
+    long ms = 0, nodes = 0;
+    int depth_given = 0;
+    int option;
+    while ((option = getopt(argc, argv, "n:t:" ENGINE_OPTIONS)) != -1) {
+        if (option == 'n') {
+            nodes = atol(optarg);
+        } else if (option == 't') {
+            ms = atol(optarg);
+        } else if (option == '?' || engine_option(option, optarg) == -1) {
+            optind = argc + 1;
+            break;
+        } else if (option == 'D') {
+            depth_given = 1;
+        }
+    }
+    if (optind >= argc || nodes < 0 || ms < 0) {
+        fprintf(stderr, "Usage: %s [-n nodes] [-t ms] [engine options] suite ...\n", argv[0]);
+        exit(EXIT_FAILURE);
+    }
+    // With only a time or node limit, deepen as far as it allows
+    int max = depth_given || (ms == 0 && nodes == 0) ? max_depth : MAXDEPTH;
+
+    for (int i = optind; i < argc; i++) {
+        if (run_suite(argv[i], max, ms, nodes) == -1) {
+            exit(EXIT_FAILURE);
+        }
+    }
+    printf("total positions %d solved %d nodes %ld time %ld nps %ld\n", total_tests, total_solved,
+           total_nodes, total_us, per_second(total_nodes, total_us));
+    exit(EXIT_SUCCESS);
+}
@@ -0,0 +1,502 @@
+/*
+ * Engine-vs-engine tournament runner
+ *
+ * Usage: tourney [-g games] [-j jobs] [-t secs] [-p plies] [-m plies] [-s seed]
+ *                [-e elo0,elo1] [-o file] [-1 options] [-2 options]
+ *   -g <num>     number of games to play (default 100)
+ *   -j <num>     number of games to play at once (default: one per core)
+ *   -t <num>     average time per move of both engines, in seconds (default 0.1)
+ *   -p <num>     number of random moves that open each game (default 4)
+ *   -m <num>     number of moves after which a game is drawn (default 300)
+ *   -s <num>     random seed for the openings (default 1)
+ *   -e <e0,e1>   stop early once a sequential probability ratio test decides
+ *                between engine 1 being e0 and e1 Elo stronger than engine 2
+ *   -o <file>    record each game in a file, one per line: the game number,
+ *                the engine with white, the result ("1-0" if white won),
+ *                the number of moves, the time in ms, and the moves
+ *   -1 <opts>    engine options for engine 1, as for ccheck (e.g. "-D 6 -S pvs"),
+ *                which may override -t with -a
+ *   -2 <opts>    engine options for engine 2
+ *
+ * Each game is played by a worker process, which runs the two engines as
+ * child processes of its own and relays moves between them over pipes, using
+ * the same protocol as ccheck; there is no display, pty or socket in between.
+ * Games come in pairs that share a random opening, with the engines swapping
+ * colors, so that neither engine gains from a lopsided opening.  Engines do
+ * not ponder (unlike under ccheck), so that each game keeps one core busy.
+ * An engine that takes many times its move time to answer is taken to have
+ * hung: it is killed, and the game is scored as a loss for it.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <signal.h>
+#include <fcntl.h>
+#include <math.h>
+#include <time.h>
+#include <poll.h>
+#include <errno.h>
+#include <sys/wait.h>
+
+#include "ccheck.h"
+#include "engine.h"
+#include "bitboard.h"
+#include "timectl.h"
+
+#define MAX_ENGINE_ARGS 32                // Words in an engine option string
+#define SPRT_ALPHA 0.05                   // Chance of accepting elo1 when elo0 holds
+#define SPRT_BETA 0.05                    // Chance of accepting elo0 when elo1 holds
+#define HANG_FACTOR 10                    // Move times after which an engine has hung
+#define HANG_SLACK_MS 2000                // Allowance on top, for startup and slow machines
+
+// Outcome of one game, sent by its worker to the runner
+typedef struct game_result {
+    int game;                             // Number of the game
+    int result;                           // 1 if engine 1 won, -1 if engine 2 won, 0 for a draw
+    int plies;                            // Moves played, including the opening
+    long ms;                              // Wall time of the game
+} GameResult;
+
+// A running engine, as seen from its worker
+typedef struct player {
+    pid_t pid;
+    FILE *in;                             // Its output
+    FILE *out;                            // Its input
+    long timeout_ms;                      // Time to answer after which it has hung
+} EnginePlayer;
+
+static char *options[2] = { "", "" };     // Engine options for engines 1 and 2
+static char *move_time = "0.1";            // Default -a for both
+static int opening_plies = 4;
+static int max_plies = 300;
+static unsigned seed = 1;
+static FILE *record;                      // Game records, or NULL
+
+// Set the engine options from a string of words, in the forked engine process
+static void configure(char *opts) {
+    char *copy = strdup(opts);
+    char *argv[MAX_ENGINE_ARGS + 2] = { "engine" };
+    int argc = 1;
+    for (char *w = strtok(copy, " \t"); w != NULL && argc <= MAX_ENGINE_ARGS; w = strtok(NULL, " \t")) {
+        argv[argc++] = w;
+    }
+    int option;
+    engine_option('a', move_time);
+    optind = 1;
+    while ((option = getopt(argc, argv, ENGINE_OPTIONS)) != -1) {
+        if (option == '?' || engine_option(option, optarg) == -1) {
+            _exit(EXIT_FAILURE);
+        }
+    }
+    // Pondering would have both engines of a game thinking at once
+    ponder_enabled = 0;
+}
+
+// The average move time an engine is given, in milliseconds: its own -a,
+// if its options have one, or else the one for both
+static long engine_move_ms(char *opts) {
+    char *copy = strdup(opts);
+    const char *secs = move_time;
+    for (char *w = strtok(copy, " \t"); w != NULL; w = strtok(NULL, " \t")) {
+        if (strncmp(w, "-a", 2) == 0) {
+            char *arg = w[2] != '\0' ? w + 2 : strtok(NULL, " \t");
+            if (arg != NULL) {
+                secs = arg;
+            }
+        }
+    }
+    long ms = (long)(strtod(secs, NULL) * 1000 + 0.5);
+    free(copy);
+    return ms;
+}
+
+// Wait for an engine to answer, for as long as it may take before it is
+// taken to have hung.  Returns 1 once it has answered, or 0 if it has hung.
+static int await_engine(EnginePlayer *ep) {
+    struct pollfd pfd = { fileno(ep->in), POLLIN, 0 };
+    long deadline = clock_ms() + ep->timeout_ms;
+    long left;
+    while ((left = deadline - clock_ms()) > 0) {
+        int n = poll(&pfd, 1, left);
+        if (n > 0) {
+            return 1;
+        }
+        if (n == -1 && errno != EINTR) {
+            return 1;                     // Let the read report the error
+        }
+    }
+    return 0;
+}
+
+// Start an engine in the given position.  Returns 0 if it is running, 1 if
+// it hung before it was ready, or -1 on error.
+static int start_engine(EnginePlayer *ep, char *opts, Board *board) {
+    int to_engine[2], from_engine[2];
+    if (pipe(to_engine) == -1 || pipe(from_engine) == -1) {
+        return -1;
+    }
+    ep->pid = fork();
+    if (ep->pid == -1) {
+        return -1;
+    }
+    if (ep->pid == 0) {
+        dup2(to_engine[0], STDIN_FILENO);
+        dup2(from_engine[1], STDOUT_FILENO);
+        close(to_engine[0]);
+        close(to_engine[1]);
+        close(from_engine[0]);
+        close(from_engine[1]);
+        configure(opts);
+        engine(board);
+        _exit(EXIT_SUCCESS);
+    }
+    close(to_engine[0]);
+    close(from_engine[1]);
+    ep->out = fdopen(to_engine[1], "w");
+    ep->in = fdopen(from_engine[0], "r");
+    // Unbuffered, so that anything not yet read is still in the pipe, where
+    // await_engine can see it
+    setvbuf(ep->in, NULL, _IONBF, 0);
+    ep->timeout_ms = HANG_FACTOR * engine_move_ms(opts) + HANG_SLACK_MS;
+
+    // The engine must have its SIGHUP handler in place before it is signaled
+    char line[256];
+    if (!await_engine(ep)) {
+        return 1;
+    }
+    if (fgets(line, sizeof(line), ep->in) == NULL) {
+        return -1;
+    }
+    return 0;
+}
+
+static void stop_engine(EnginePlayer *ep) {
+    kill(ep->pid, SIGKILL);
+    waitpid(ep->pid, NULL, 0);
+    fclose(ep->in);
+    fclose(ep->out);
+}
+
+// Play a random opening: moves chosen evenly among those that do not retreat
+static void play_opening(Board *board, Move *moves, unsigned s) {
+    Bitboard bb;
+    Move list[MAXMOVES];
+    bb_newbd(&bb);
+    for (int i = 0; i < opening_plies; i++) {
+        int n = bb_moves(&bb, list), k = 0;
+        for (int j = 0; j < n; j++) {
+            int progress = (row_to(list[j]) - row_from(list[j])) + (col_to(list[j]) - col_from(list[j]));
+            if (bb.tomove == X ? progress >= 0 : progress <= 0) {
+                list[k++] = list[j];
+            }
+        }
+        moves[i] = list[rand_r(&s) % k];
+        bb_apply(&bb, moves[i]);
+        apply(board, moves[i]);
+    }
+}
+
+// Play one game; engine 1 has white in even-numbered games
+static GameResult play_game(int game) {
+    GameResult gr = { game, 0, 0, 0 };
+    long start = clock_ms();
+    Board *board = newbd();
+    Move moves[max_plies + opening_plies];
+    // Both games of a pair get the same opening
+    play_opening(board, moves, seed * 7919 + game / 2);
+    gr.plies = opening_plies;
+
+    int first = game % 2;                 // Engine playing white
+    int hung = -1;                        // Engine that stopped answering, if any
+    EnginePlayer eng[2];
+    for (int i = 0; i < 2; i++) {
+        int started = start_engine(&eng[i], options[i], board);
+        if (started == -1) {
+            fprintf(stderr, "Game %d: could not start engine %d\n", game + 1, i + 1);
+            _exit(EXIT_FAILURE);
+        }
+        if (started == 1 && hung == -1) {
+            hung = i;
+        }
+    }
+
+    int won = 0;
+    while (hung == -1 && !(won = game_over(board)) && gr.plies < max_plies) {
+        int who = player_to_move(board) == X ? first : 1 - first;
+        EnginePlayer *mover = &eng[who];
+        EnginePlayer *other = &eng[1 - who];
+        fprintf(mover->out, "<\n");
+        fflush(mover->out);
+        kill(mover->pid, SIGHUP);
+        if (!await_engine(mover)) {
+            hung = who;
+            break;
+        }
+        Move m = read_move_from_pipe(mover->in, board);
+        if (m == 0) {
+            fprintf(stderr, "Game %d: engine died\n", game + 1);
+            _exit(EXIT_FAILURE);
+        }
+
+        fprintf(other->out, ">");
+        print_move(board, m, other->out);
+        fprintf(other->out, "\n");
+        fflush(other->out);
+        kill(other->pid, SIGHUP);
+        if (!await_engine(other)) {
+            hung = 1 - who;
+            break;
+        }
+        char ack[256];
+        if (fgets(ack, sizeof(ack), other->in) == NULL) {
+            fprintf(stderr, "Game %d: engine died\n", game + 1);
+            _exit(EXIT_FAILURE);
+        }
+        moves[gr.plies++] = m;
+        apply(board, m);
+    }
+    for (int i = 0; i < 2; i++) {
+        stop_engine(&eng[i]);
+    }
+
+    // An engine that hung loses, whoever was ahead
+    if (hung != -1) {
+        fprintf(stderr, "Game %d: engine %d hung, scored as a loss\n", game + 1, hung + 1);
+        won = hung == first ? -1 : 1;
+    }
+
+    // game_over gives the winner as 1 for white (X), -1 for black (O)
+    if (won != 0) {
+        gr.result = (won == 1) == (first == 0) ? 1 : -1;
+    }
+    gr.ms = clock_ms() - start;
+
+    if (record != NULL) {
+        // One line per game, written at once so that workers don't interleave
+        char *buf = NULL;
+        size_t len = 0;
+        FILE *s = open_memstream(&buf, &len);
+        Board *replay = newbd();
+        fprintf(s, "%d %d %s %d %ld", game + 1, first + 1,
+                won == 1 ? "1-0" : won == -1 ? "0-1" : "1/2", gr.plies, gr.ms);
+        for (int i = 0; i < gr.plies; i++) {
+            fprintf(s, " ");
+            print_move(replay, moves[i], s);
+            apply(replay, moves[i]);
+        }
+        fprintf(s, "\n");
+        fclose(s);
+        write(fileno(record), buf, len);
+        free(buf);
+    }
+    return gr;
+}
+
+// Log-likelihood ratio of engine 1 being elo1 rather than elo0 stronger,
+// given the results so far (the normal approximation to the trinomial GSPRT)
+static double llr(long wins, long draws, long losses, double elo0, double elo1) {
+    if (wins + draws + losses == 0) {
+        return 0;
+    }
+    // Until every outcome has been seen, half a game of each keeps the
+    // variance from vanishing
+    double w = wins, d = draws, l = losses;
+    if (wins == 0 || draws == 0 || losses == 0) {
+        w += 0.5;
+        d += 0.5;
+        l += 0.5;
+    }
+    double n = w + d + l;
+    double score = (w + d / 2) / n;
+    double var = (w * pow(1 - score, 2) + d * pow(0.5 - score, 2) + l * pow(score, 2)) / n;
+    double s0 = 1 / (1 + pow(10, -elo0 / 400));
+    double s1 = 1 / (1 + pow(10, -elo1 / 400));
+    return (s1 - s0) * (2 * score - s0 - s1) * n / (2 * var);
+}
+
+static double elo(double score) {
+    if (score <= 0 || score >= 1) {
+        return score <= 0 ? -INFINITY : INFINITY;
+    }
+    return -400 * log10(1 / score - 1);
+}
+
+int main(int argc, char *argv[])
+{
+    int games = 100;
+    int jobs = sysconf(_SC_NPROCESSORS_ONLN);
+    int sprt = 0;
+    double elo0 = 0, elo1 = 5;
+    int option;
+
+    while ((option = getopt(argc, argv, "g:j:t:p:m:s:e:o:1:2:")) != -1) {
+        switch (option) {
+            case 'g':
+                games = atoi(optarg);
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                break;
+            case 't':
+                move_time = optarg;
+                break;
+            case 'p':
+                opening_plies = atoi(optarg);
+                break;
+            case 'm':
+                max_plies = atoi(optarg);
+                break;
+            case 's':
+                seed = atoi(optarg);
+                break;
+            case 'e':
+                if (sscanf(optarg, "%lf,%lf", &elo0, &elo1) != 2 || elo0 >= elo1) {
+                    fprintf(stderr, "SPRT bounds must be given as elo0,elo1 with elo0 < elo1.\n");
+                    exit(EXIT_FAILURE);
+                }
+                sprt = 1;
+                break;
+            case 'o':
+                record = fopen(optarg, "w");
+                if (record == NULL) {
+                    perror(optarg);
+                    exit(EXIT_FAILURE);
+                }
+                break;
+            case '1':
+                options[0] = optarg;
+                break;
+            case '2':
+                options[1] = optarg;
+                break;
+            default:
+                fprintf(stderr, "Usage: %s [-g games] [-j jobs] [-t secs] [-p plies] [-m plies] [-s seed] "
+                        "[-e elo0,elo1] [-o file] [-1 options] [-2 options]\n", argv[0]);
+                exit(EXIT_FAILURE);
+        }
+    }
+    if (jobs < 1) {
+        jobs = 1;
+    }
+    if (max_plies <= opening_plies) {
+        fprintf(stderr, "Games must be longer than their openings.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // Workers report through one pipe; results are small enough to be written atomically
+    int results[2];
+    if (pipe(results) == -1) {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+    fcntl(results[0], F_SETFL, O_NONBLOCK);
+    signal(SIGPIPE, SIG_IGN);
+
+    long wins = 0, draws = 0, losses = 0, errors = 0, plies = 0, ms = 0;
+    int next = 0, running = 0, decided = 0;
+    pid_t *workers = calloc(jobs, sizeof(pid_t));
+    double lower = log(SPRT_BETA / (1 - SPRT_ALPHA)), upper = log((1 - SPRT_BETA) / SPRT_ALPHA);
+    long start = clock_ms();
+
+    while (running > 0 || (next < games && !decided)) {
+        // Keep every job busy
+        while (running < jobs && next < games && !decided) {
+            pid_t pid = fork();
+            if (pid == -1) {
+                perror("fork");
+                break;
+            }
+            if (pid == 0) {
+                // Each worker is a process group with its engines, to be killed as one
+                setpgid(0, 0);
+                close(results[0]);
+                GameResult gr = play_game(next);
+                write(results[1], &gr, sizeof(gr));
+                _exit(EXIT_SUCCESS);
+            }
+            setpgid(pid, pid);
+            for (int i = 0; i < jobs; i++) {
+                if (workers[i] == 0) {
+                    workers[i] = pid;
+                    break;
+                }
+            }
+            running++;
+            next++;
+        }
+
+        int status;
+        pid_t pid = wait(&status);
+        if (pid == -1) {
+            break;
+        }
+        for (int i = 0; i < jobs; i++) {
+            if (workers[i] == pid) {
+                workers[i] = 0;
+            }
+        }
+        running--;
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            errors++;
+        }
+
+        GameResult gr;
+        while (read(results[0], &gr, sizeof(gr)) == sizeof(gr)) {
+            if (gr.result == 1) {
+                wins++;
+            } else if (gr.result == -1) {
+                losses++;
+            } else {
+                draws++;
+            }
+            plies += gr.plies;
+            ms += gr.ms;
+            long n = wins + draws + losses;
+            double ratio = llr(wins, draws, losses, elo0, elo1);
+            fprintf(stderr, "Game %d: %s  (+%ld =%ld -%ld, Elo %+.1f", gr.game + 1,
+                    gr.result == 1 ? "1 wins" : gr.result == -1 ? "2 wins" : "draw",
+                    wins, draws, losses, elo((wins + draws / 2.0) / n));
+            if (sprt) {
+                fprintf(stderr, ", LLR %.2f [%.2f, %.2f]", ratio, lower, upper);
+            }
+            fprintf(stderr, ")\n");
+            if (sprt && !decided && (ratio <= lower || ratio >= upper)) {
+                decided = ratio >= upper ? 1 : -1;
+            }
+        }
+
+        // Once the test has decided, the games still being played don't matter
+        if (decided) {
+            for (int i = 0; i < jobs; i++) {
+                if (workers[i] != 0) {
+                    kill(-workers[i], SIGKILL);
+                    waitpid(workers[i], NULL, 0);
+                    workers[i] = 0;
+                }
+            }
+            running = 0;
+        }
+    }
+
+    long n = wins + draws + losses;
+    long elapsed = clock_ms() - start;
+    printf("Games: %ld (+%ld =%ld -%ld), errors: %ld\n", n, wins, draws, losses, errors);
+    if (n > 0) {
+        double score = (wins + draws / 2.0) / n;
+        printf("Score of engine 1: %.1f%%, Elo difference: %+.1f\n", 100 * score, elo(score));
+        printf("Moves: %ld, %.1f moves/sec per game, %.1f moves/sec overall (%.1f s)\n",
+               plies, ms > 0 ? 1000.0 * plies / ms : 0, elapsed > 0 ? 1000.0 * plies / elapsed : 0,
+               elapsed / 1000.0);
+    }
+    if (sprt) {
+        printf("SPRT [%g, %g]: %s\n", elo0, elo1,
+               decided == 1 ? "H1 accepted (engine 1 is stronger)" :
+               decided == -1 ? "H0 accepted (engine 1 is not stronger)" : "undecided");
+    }
+    if (record != NULL) {
+        fclose(record);
+    }
+    return EXIT_SUCCESS;
+}